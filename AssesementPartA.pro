@@ -1,4 +1,4 @@
-QT += core gui widgets opengl openglwidgets
+QT += core gui widgets opengl openglwidgets network
 
 CONFIG += c++17
 
@@ -6,15 +6,46 @@ TARGET = CubeRotationApp
 TEMPLATE = app
 
 SOURCES += \
+    allocstats.cpp \
+    cubepicker.cpp \
+    cuberenderer.cpp \
+    cubescene.cpp \
     cubewidget.cpp \
     dialogs.cpp \
-    main.cpp
+    framearena.cpp \
+    ktxfile.cpp \
+    lightcluster.cpp \
+    main.cpp \
+    renderqueue.cpp \
+    renderserver.cpp \
+    scenefile.cpp \
+    textoverlay.cpp \
+    tracerecorder.cpp
 
 HEADERS += \
+    allocstats.h \
+    cubeinstance.h \
+    cubepicker.h \
+    cuberenderer.h \
+    cubescene.h \
     cubewidget.h \
-    dialogs.h
+    dialogs.h \
+    framearena.h \
+    ktxfile.h \
+    lightcluster.h \
+    renderqueue.h \
+    renderserver.h \
+    scenefile.h \
+    textoverlay.h \
+    tracerecorder.h
 
 unix|windows: LIBS += -L$$PWD/w/ -lopengl32 -lglu32
+# shm_open() for the render server's shared memory lives in librt on older glibc.
+linux: LIBS += -lrt
+
+# Per-frame heap allocation counting for replay benchmarks (--fail-on-alloc), e.g.
+# qmake CONFIG+=alloc_tracking. It replaces malloc (glibc) or operator new, so it is off by default.
+alloc_tracking: DEFINES += CUBE_ALLOC_TRACKING
 
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
@@ -33,3 +64,6 @@ INCLUDEPATH += C:/Users/varask/Desktop/Cranfield/Vizualization/libs/glm
 RESOURCES += \
     resources.qrc
 
+# The baked texture is produced by tools/texbaker (see README); without it the PNG is used.
+exists($$PWD/textures/texture.ktx): RESOURCES += textures_baked.qrc
+
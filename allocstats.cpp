@@ -0,0 +1,290 @@
+/**
+ * @file allocstats.cpp
+ * @brief Heap allocation counting for the per-frame allocation report.
+ *
+ * With CUBE_ALLOC_TRACKING the allocator entry points are replaced by thin wrappers that bump
+ * thread-local counters and forward to the real allocator. On glibc the C allocator itself is
+ * interposed (the executable's malloc takes precedence over libc's for every library, and
+ * glibc exports the real implementation as __libc_malloc), so allocations made by Qt's
+ * containers and by libraries are counted too. The aligned entry points and reallocarray are
+ * wrapped as well, since glibc implements them without going through malloc. Other platforms
+ * fall back to replacing every form of the global operator new and delete, plain, nothrow
+ * and aligned.
+ */
+
+#include "allocstats.h"
+#include <cerrno>
+#include <cstdlib>
+#include <new>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+#ifdef CUBE_ALLOC_TRACKING
+
+namespace {
+// Plain data, so it is usable from inside malloc before any constructor could run.
+thread_local AllocStats::Counters threadCounters = {0, 0, 0};
+
+inline void countAllocation(std::size_t size)
+{
+    ++threadCounters.allocations;
+    threadCounters.bytes += size;
+}
+}
+
+#if defined(__GLIBC__)
+
+extern "C" {
+void *__libc_malloc(std::size_t size);
+void *__libc_calloc(std::size_t count, std::size_t size);
+void *__libc_realloc(void *pointer, std::size_t size);
+void *__libc_memalign(std::size_t alignment, std::size_t size);
+void *__libc_valloc(std::size_t size);
+void *__libc_pvalloc(std::size_t size);
+void __libc_free(void *pointer);
+
+void *malloc(std::size_t size) noexcept
+{
+    countAllocation(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(std::size_t count, std::size_t size) noexcept
+{
+    std::size_t bytes;
+    if (!__builtin_mul_overflow(count, size, &bytes))
+        countAllocation(bytes);
+    return __libc_calloc(count, size); // fails with ENOMEM on overflow
+}
+
+void *realloc(void *pointer, std::size_t size) noexcept
+{
+    if (pointer && size == 0)
+        ++threadCounters.frees; // glibc frees the block and returns nullptr
+    else
+        countAllocation(size);
+    return __libc_realloc(pointer, size);
+}
+
+// glibc's own reallocarray calls __libc_realloc directly, past the wrapper above.
+void *reallocarray(void *pointer, std::size_t count, std::size_t size) noexcept
+{
+    std::size_t bytes;
+    if (__builtin_mul_overflow(count, size, &bytes)) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    return realloc(pointer, bytes);
+}
+
+void *memalign(std::size_t alignment, std::size_t size) noexcept
+{
+    countAllocation(size);
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(std::size_t alignment, std::size_t size) noexcept
+{
+    countAllocation(size);
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **pointer, std::size_t alignment, std::size_t size) noexcept
+{
+    if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0 || alignment == 0)
+        return EINVAL;
+    countAllocation(size);
+    void *memory = __libc_memalign(alignment, size);
+    if (!memory)
+        return ENOMEM;
+    *pointer = memory;
+    return 0;
+}
+
+void *valloc(std::size_t size) noexcept
+{
+    countAllocation(size);
+    return __libc_valloc(size);
+}
+
+void *pvalloc(std::size_t size) noexcept
+{
+    countAllocation(size);
+    return __libc_pvalloc(size);
+}
+
+void free(void *pointer) noexcept
+{
+    if (pointer)
+        ++threadCounters.frees;
+    __libc_free(pointer);
+}
+}
+
+#else
+
+namespace {
+void *allocateAligned(std::size_t size, std::size_t alignment)
+{
+#ifdef _WIN32
+    return _aligned_malloc(size ? size : 1, alignment);
+#else
+    void *pointer = nullptr;
+    return posix_memalign(&pointer, alignment, size ? size : 1) == 0 ? pointer : nullptr;
+#endif
+}
+
+void freeAligned(void *pointer)
+{
+#ifdef _WIN32
+    _aligned_free(pointer);
+#else
+    std::free(pointer);
+#endif
+}
+}
+
+void *operator new(std::size_t size)
+{
+    countAllocation(size);
+    if (void *pointer = std::malloc(size ? size : 1))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *pointer) noexcept
+{
+    if (pointer)
+        ++threadCounters.frees;
+    std::free(pointer);
+}
+
+void operator delete[](void *pointer) noexcept
+{
+    operator delete(pointer);
+}
+
+void operator delete(void *pointer, std::size_t) noexcept
+{
+    operator delete(pointer);
+}
+
+void operator delete[](void *pointer, std::size_t) noexcept
+{
+    operator delete(pointer);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    countAllocation(size);
+    return std::malloc(size ? size : 1);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &tag) noexcept
+{
+    return operator new(size, tag);
+}
+
+void operator delete(void *pointer, const std::nothrow_t &) noexcept
+{
+    operator delete(pointer);
+}
+
+void operator delete[](void *pointer, const std::nothrow_t &) noexcept
+{
+    operator delete(pointer);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment)
+{
+    countAllocation(size);
+    if (void *pointer = allocateAligned(size, std::size_t(alignment)))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    countAllocation(size);
+    return allocateAligned(size, std::size_t(alignment));
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t &tag) noexcept
+{
+    return operator new(size, alignment, tag);
+}
+
+void operator delete(void *pointer, std::align_val_t) noexcept
+{
+    if (pointer)
+        ++threadCounters.frees;
+    freeAligned(pointer);
+}
+
+void operator delete[](void *pointer, std::align_val_t alignment) noexcept
+{
+    operator delete(pointer, alignment);
+}
+
+void operator delete(void *pointer, std::size_t, std::align_val_t alignment) noexcept
+{
+    operator delete(pointer, alignment);
+}
+
+void operator delete[](void *pointer, std::size_t, std::align_val_t alignment) noexcept
+{
+    operator delete(pointer, alignment);
+}
+
+void operator delete(void *pointer, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    operator delete(pointer, alignment);
+}
+
+void operator delete[](void *pointer, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+    operator delete(pointer, alignment);
+}
+
+#endif
+
+/**
+ * @brief Returns true if allocation counting is compiled in.
+ */
+bool AllocStats::isEnabled()
+{
+    return true;
+}
+
+/**
+ * @brief Returns the counters of the calling thread since it started.
+ */
+AllocStats::Counters AllocStats::current()
+{
+    return threadCounters;
+}
+
+#else
+
+bool AllocStats::isEnabled()
+{
+    return false;
+}
+
+AllocStats::Counters AllocStats::current()
+{
+    return {0, 0, 0};
+}
+
+#endif
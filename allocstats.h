@@ -0,0 +1,34 @@
+#ifndef ALLOCSTATS_H
+#define ALLOCSTATS_H
+
+#include <QtGlobal>
+
+/**
+ * @brief Heap allocation counters of the calling thread.
+ *
+ * Counting is compiled in with `CONFIG += alloc_tracking` (which defines CUBE_ALLOC_TRACKING).
+ * On glibc every malloc/calloc/realloc/reallocarray and aligned allocation is counted, which
+ * includes operator new and Qt's containers; elsewhere only operator new (all its forms) is
+ * counted. Without the option the counters stay
+ * zero and isEnabled() returns false.
+ */
+namespace AllocStats {
+
+struct Counters
+{
+    quint64 allocations; ///< malloc, calloc, realloc, aligned allocation and operator new calls.
+    quint64 bytes;       ///< Bytes requested by those calls.
+    quint64 frees;       ///< free, realloc to size 0 and operator delete calls.
+
+    Counters operator-(const Counters &other) const
+    {
+        return {allocations - other.allocations, bytes - other.bytes, frees - other.frees};
+    }
+};
+
+bool isEnabled();
+Counters current();
+
+} // namespace AllocStats
+
+#endif // ALLOCSTATS_H
@@ -0,0 +1,134 @@
+#ifndef CUBEINSTANCE_H
+#define CUBEINSTANCE_H
+
+#include <QMatrix4x4>
+#include <QQuaternion>
+#include <QVector3D>
+#include <cmath>
+
+/**
+ * @brief Placement of one cube, laid out exactly as it is stored in the instance buffer and
+ * in scene files (two vec4 per cube).
+ */
+struct CubeTransform
+{
+    float position[3];
+    float scale;          ///< Uniform scale (edge length of the cube).
+    float orientation[4]; ///< Unit quaternion stored as (x, y, z, w).
+
+    static CubeTransform identity()
+    {
+        return {{0.0f, 0.0f, 0.0f}, 1.0f, {0.0f, 0.0f, 0.0f, 1.0f}};
+    }
+
+    QVector3D translation() const
+    {
+        return QVector3D(position[0], position[1], position[2]);
+    }
+
+    QQuaternion rotation() const
+    {
+        return QQuaternion(orientation[3], orientation[0], orientation[1], orientation[2]);
+    }
+
+    void setTranslation(const QVector3D &t)
+    {
+        position[0] = t.x();
+        position[1] = t.y();
+        position[2] = t.z();
+    }
+
+    void setRotation(const QQuaternion &q)
+    {
+        const QQuaternion n = q.normalized();
+        orientation[0] = n.x();
+        orientation[1] = n.y();
+        orientation[2] = n.z();
+        orientation[3] = n.scalar();
+    }
+
+    QMatrix4x4 toMatrix() const
+    {
+        QMatrix4x4 m;
+        m.translate(translation());
+        m.rotate(rotation());
+        m.scale(scale);
+        return m;
+    }
+};
+
+static_assert(sizeof(CubeTransform) == 32, "CubeTransform must match the instance buffer layout");
+
+/**
+ * @brief Constant-speed rotation of one cube, laid out exactly as it is stored in the
+ * animation buffer and in scene files (two vec4 per cube).
+ *
+ * A Spin turns the cube about an axis through its own center, given in the cube's local
+ * frame. A Line rotation turns it about a world-space line through pivot, like
+ * CubeWidget::setCustomRotation(). The animated transform is a function of the static
+ * transform and the elapsed animation ticks only, so the CPU (at()) can evaluate the pose
+ * the GPU draws. The rotation angle is computed the same way on both; the quaternions may
+ * still differ in the last bits, since sin/cos are not bit-identical across CPUs and GPUs.
+ */
+struct CubeAnimation
+{
+    enum Mode { Spin = 0, Line = 1 };
+
+    float pivot[3];       ///< A point on the line (Line mode only).
+    float speed;          ///< Degrees per animation tick; 0 means static.
+    float axis[3];        ///< Rotation axis (normalized).
+    float mode;           ///< CubeAnimation::Mode stored as float so the record stays two vec4.
+
+    static CubeAnimation none()
+    {
+        return {{0.0f, 0.0f, 0.0f}, 0.0f, {0.0f, 1.0f, 0.0f}, float(Spin)};
+    }
+
+    static CubeAnimation spin(const QVector3D &localAxis, float degreesPerTick)
+    {
+        const QVector3D a = localAxis.normalized();
+        return {{0.0f, 0.0f, 0.0f}, degreesPerTick, {a.x(), a.y(), a.z()}, float(Spin)};
+    }
+
+    static CubeAnimation aboutLine(const QVector3D &b, const QVector3D &d, float degreesPerTick)
+    {
+        const QVector3D a = d.normalized();
+        return {{b.x(), b.y(), b.z()}, degreesPerTick, {a.x(), a.y(), a.z()}, float(Line)};
+    }
+
+    bool isStatic() const { return speed == 0.0f; }
+
+    /// Returns the speed in fixed point, in units of 2^-32 turns per tick. The transform
+    /// feedback shader derives it with the same float operations.
+    quint32 turnStep() const
+    {
+        const float turns = speed * (1.0f / 360.0f);
+        const float step = std::floor((turns - std::floor(turns)) * 4294967296.0f + 0.5f);
+        return step >= 4294967296.0f ? 0u : quint32(step);
+    }
+
+    /// Returns base advanced by ticks animation ticks (negative ticks run the animation
+    /// backwards). The phase is turnStep() * ticks modulo one turn in 32-bit integer math,
+    /// as in the shader, so it stays exact however long the clock runs.
+    CubeTransform at(const CubeTransform &base, qint64 ticks) const
+    {
+        if (isStatic())
+            return base;
+        const quint32 phase = turnStep() * quint32(ticks);
+        const float angle = float(phase) * (360.0f / 4294967296.0f);
+        const QQuaternion r = QQuaternion::fromAxisAndAngle(QVector3D(axis[0], axis[1], axis[2]), angle);
+        CubeTransform t = base;
+        if (mode == float(Line)) {
+            const QVector3D p(pivot[0], pivot[1], pivot[2]);
+            t.setTranslation(p + r.rotatedVector(base.translation() - p));
+            t.setRotation(r * base.rotation());
+        } else {
+            t.setRotation(base.rotation() * r);
+        }
+        return t;
+    }
+};
+
+static_assert(sizeof(CubeAnimation) == 32, "CubeAnimation must match the animation buffer layout");
+
+#endif // CUBEINSTANCE_H
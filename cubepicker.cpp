@@ -0,0 +1,410 @@
+/**
+ * @file cubepicker.cpp
+ * @brief Ray picking of cubes accelerated by a bounding volume hierarchy.
+ *
+ * The BVH stores the world-space axis-aligned bounds of every cube; for an animated cube they
+ * enclose every pose of its animation, so the tree stays valid while the clock runs and only
+ * the cubes in leaves the ray reaches are posed. It is built top-down by
+ * splitting at the median centroid along the longest axis, with up to kLeafSize cubes per leaf.
+ * When transforms change the tree is not rebuilt: the changed cubes' leaves and their ancestors
+ * are refitted (or the whole tree for large changes), lazily on the next pick. Candidates found
+ * by the traversal are tested exactly against the oriented cube with a slab test in the cube's
+ * local frame, and the nearest hit wins.
+ */
+
+#include "cubepicker.h"
+#include <algorithm>
+#include <utility>
+#include <cmath>
+#include <limits>
+
+namespace {
+constexpr int kLeafSize = 4;
+// Median splits halve the cube count at each level, so even INT_MAX cubes give a tree at most
+// 32 levels deep; the traversal stack never holds more than depth + 1 entries.
+constexpr int kMaxStackDepth = 64;
+constexpr float kInfinity = std::numeric_limits<float>::infinity();
+}
+
+/**
+ * @brief Constructs an empty picker; the BVH is built on the first pick.
+ */
+CubePicker::CubePicker()
+    : builtCount(-1),
+      treeDepth(0),
+      dirtyBegin(0),
+      dirtyEnd(0)
+{
+}
+
+/**
+ * @brief Records that the transforms of cubes [begin, end) changed.
+ */
+void CubePicker::invalidate(int begin, int end)
+{
+    if (dirtyEnd <= dirtyBegin) {
+        dirtyBegin = begin;
+        dirtyEnd = end;
+    } else {
+        dirtyBegin = std::min(dirtyBegin, begin);
+        dirtyEnd = std::max(dirtyEnd, end);
+    }
+}
+
+/**
+ * @brief Forces a full rebuild on the next pick (e.g. after loading a new scene).
+ */
+void CubePicker::reset()
+{
+    builtCount = -1;
+    dirtyBegin = dirtyEnd = 0;
+}
+
+/**
+ * @brief Computes the world-space AABB of an oriented cube.
+ *
+ * Each half extent is the cube's half size times the sum of the absolute values of the
+ * corresponding row of its rotation matrix.
+ */
+void CubePicker::cubeBounds(const CubeTransform &t, float bmin[3], float bmax[3])
+{
+    const QMatrix3x3 r = t.rotation().toRotationMatrix();
+    const float half = 0.5f * t.scale;
+    for (int i = 0; i < 3; ++i) {
+        const float extent = half * (std::fabs(r(i, 0)) + std::fabs(r(i, 1)) + std::fabs(r(i, 2)));
+        bmin[i] = t.position[i] - extent;
+        bmax[i] = t.position[i] + extent;
+    }
+}
+
+/**
+ * @brief Computes an AABB that contains every pose of an animated cube.
+ * @param t The cube's static transform.
+ * @param animation Its animation.
+ *
+ * A spinning cube stays inside its bounding sphere. A cube rotating about a line keeps its
+ * center on a circle around the line, so the bounds are those of the circle grown by the
+ * bounding sphere's radius; a circle of radius rho about unit axis a extends
+ * rho * sqrt(1 - a_i^2) along world axis i.
+ */
+void CubePicker::sweptBounds(const CubeTransform &t, const CubeAnimation &animation, float bmin[3],
+                             float bmax[3])
+{
+    if (animation.isStatic()) {
+        cubeBounds(t, bmin, bmax);
+        return;
+    }
+    const float radius = 0.5f * std::sqrt(3.0f) * t.scale;
+    QVector3D center = t.translation();
+    float extent[3] = {radius, radius, radius};
+    if (animation.mode == float(CubeAnimation::Line)) {
+        const QVector3D pivot(animation.pivot[0], animation.pivot[1], animation.pivot[2]);
+        const QVector3D axis(animation.axis[0], animation.axis[1], animation.axis[2]);
+        const QVector3D offset = center - pivot;
+        center = pivot + axis * QVector3D::dotProduct(offset, axis);
+        const float rho = (t.translation() - center).length();
+        for (int i = 0; i < 3; ++i)
+            extent[i] += rho * std::sqrt(std::max(0.0f, 1.0f - axis[i] * axis[i]));
+    }
+    for (int i = 0; i < 3; ++i) {
+        bmin[i] = center[i] - extent[i];
+        bmax[i] = center[i] + extent[i];
+    }
+}
+
+/**
+ * @brief Builds the BVH from scratch.
+ */
+void CubePicker::rebuild(const QList<CubeTransform> &transforms, const QList<CubeAnimation> &animations)
+{
+    const int n = transforms.size();
+    primIndices.resize(n);
+    leafOfPrim.resize(n);
+    centroids.resize(n);
+    for (int i = 0; i < n; ++i) {
+        primIndices[i] = i;
+        centroids[i] = transforms[i].translation();
+    }
+    nodes.clear();
+    parents.clear();
+    nodes.reserve(std::max(1, 2 * n / kLeafSize + 1));
+    parents.reserve(nodes.capacity());
+    nodes.append(Node());
+    parents.append(-1);
+    treeDepth = 1;
+    if (n > 0)
+        buildNode(transforms, animations, 0, 0, n, 1);
+    else
+        nodes[0] = {{0, 0, 0}, 0, {0, 0, 0}, 0};
+    Q_ASSERT(treeDepth < kMaxStackDepth);
+    builtCount = n;
+    dirtyBegin = dirtyEnd = 0;
+}
+
+/**
+ * @brief Recursively builds the subtree for primitives [first, first + count).
+ * @param depth Level of the node, 1 for the root.
+ */
+void CubePicker::buildNode(const QList<CubeTransform> &transforms, const QList<CubeAnimation> &animations,
+                           int nodeIndex, int first, int count, int depth)
+{
+    treeDepth = std::max(treeDepth, depth);
+    if (count <= kLeafSize) {
+        nodes[nodeIndex].first = first;
+        nodes[nodeIndex].count = count;
+        for (int i = first; i < first + count; ++i)
+            leafOfPrim[primIndices[i]] = nodeIndex;
+        refitNode(transforms, animations, nodeIndex);
+        return;
+    }
+
+    QVector3D cmin = centroids[primIndices[first]];
+    QVector3D cmax = cmin;
+    for (int i = first + 1; i < first + count; ++i) {
+        const QVector3D &c = centroids[primIndices[i]];
+        cmin = QVector3D(std::min(cmin.x(), c.x()), std::min(cmin.y(), c.y()), std::min(cmin.z(), c.z()));
+        cmax = QVector3D(std::max(cmax.x(), c.x()), std::max(cmax.y(), c.y()), std::max(cmax.z(), c.z()));
+    }
+    const QVector3D extent = cmax - cmin;
+    int axis = 0;
+    if (extent.y() > extent[axis])
+        axis = 1;
+    if (extent.z() > extent[axis])
+        axis = 2;
+
+    const int half = count / 2;
+    int *begin = primIndices.data() + first;
+    std::nth_element(begin, begin + half, begin + count, [this, axis](int a, int b) {
+        return centroids[a][axis] < centroids[b][axis];
+    });
+
+    const int left = nodes.size();
+    nodes.append(Node());
+    nodes.append(Node());
+    parents.append(nodeIndex);
+    parents.append(nodeIndex);
+    nodes[nodeIndex].first = left;
+    nodes[nodeIndex].count = 0;
+    buildNode(transforms, animations, left, first, half, depth + 1);
+    buildNode(transforms, animations, left + 1, first + half, count - half, depth + 1);
+    refitNode(transforms, animations, nodeIndex);
+}
+
+/**
+ * @brief Recomputes one node's bounds from its primitives (leaf) or children (internal).
+ * @param animations Empty, or one animation per cube; animated cubes get swept bounds.
+ */
+void CubePicker::refitNode(const QList<CubeTransform> &transforms, const QList<CubeAnimation> &animations,
+                           int nodeIndex)
+{
+    Node &node = nodes[nodeIndex];
+    float bmin[3] = {kInfinity, kInfinity, kInfinity};
+    float bmax[3] = {-kInfinity, -kInfinity, -kInfinity};
+    if (node.count > 0) {
+        for (int i = node.first; i < node.first + node.count; ++i) {
+            const int prim = primIndices[i];
+            float pmin[3], pmax[3];
+            if (animations.isEmpty())
+                cubeBounds(transforms[prim], pmin, pmax);
+            else
+                sweptBounds(transforms[prim], animations[prim], pmin, pmax);
+            for (int a = 0; a < 3; ++a) {
+                bmin[a] = std::min(bmin[a], pmin[a]);
+                bmax[a] = std::max(bmax[a], pmax[a]);
+            }
+        }
+    } else {
+        const Node &l = nodes[node.first];
+        const Node &r = nodes[node.first + 1];
+        for (int a = 0; a < 3; ++a) {
+            bmin[a] = std::min(l.bmin[a], r.bmin[a]);
+            bmax[a] = std::max(l.bmax[a], r.bmax[a]);
+        }
+    }
+    for (int a = 0; a < 3; ++a) {
+        node.bmin[a] = bmin[a];
+        node.bmax[a] = bmax[a];
+    }
+}
+
+/**
+ * @brief Brings the BVH up to date with the transforms.
+ *
+ * A changed cube count triggers a rebuild. Small dirty ranges refit each affected leaf and
+ * walk up to the root; large ones refit every node bottom-up (children always have larger
+ * indices than their parent, so a reverse sweep visits children first).
+ */
+void CubePicker::refit(const QList<CubeTransform> &transforms, const QList<CubeAnimation> &animations)
+{
+    if (builtCount != transforms.size()) {
+        rebuild(transforms, animations);
+        return;
+    }
+    if (dirtyEnd <= dirtyBegin)
+        return;
+    const int dirtyCount = dirtyEnd - dirtyBegin;
+    if (dirtyCount > 64 && dirtyCount > builtCount / 16) {
+        for (int i = nodes.size() - 1; i >= 0; --i)
+            refitNode(transforms, animations, i);
+    } else {
+        for (int prim = dirtyBegin; prim < std::min(dirtyEnd, builtCount); ++prim) {
+            for (int node = leafOfPrim[prim]; node >= 0; node = parents[node])
+                refitNode(transforms, animations, node);
+        }
+    }
+    dirtyBegin = dirtyEnd = 0;
+}
+
+/**
+ * @brief Slab test of a ray against a node's bounds.
+ * @param tEntry Receives the entry distance when the ray hits closer than tMax.
+ *
+ * Axes the ray is parallel to are tested by position, since 0 * inf for an origin on a slab
+ * plane would be NaN.
+ */
+bool CubePicker::intersectBounds(const Node &node, const Ray &ray, float tMax, float *tEntry)
+{
+    float t0 = 0.0f;
+    float t1 = tMax;
+    for (int a = 0; a < 3; ++a) {
+        if (ray.direction[a] == 0.0f) {
+            if (ray.origin[a] < node.bmin[a] || ray.origin[a] > node.bmax[a])
+                return false;
+            continue;
+        }
+        float tNear = (node.bmin[a] - ray.origin[a]) * ray.invDir[a];
+        float tFar = (node.bmax[a] - ray.origin[a]) * ray.invDir[a];
+        if (tNear > tFar)
+            std::swap(tNear, tFar);
+        t0 = tNear > t0 ? tNear : t0;
+        t1 = tFar < t1 ? tFar : t1;
+        if (t0 > t1)
+            return false;
+    }
+    *tEntry = t0;
+    return true;
+}
+
+/**
+ * @brief Exact ray/oriented-cube test, performed in the cube's local frame.
+ * @param tHit Receives the distance along the ray to the entry point.
+ */
+bool CubePicker::intersectCube(const CubeTransform &t, const Ray &ray, float *tHit)
+{
+    const QQuaternion inverse = t.rotation().conjugated();
+    const QVector3D o = inverse.rotatedVector(ray.origin - t.translation());
+    const QVector3D d = inverse.rotatedVector(ray.direction);
+    const float half = 0.5f * t.scale;
+    float t0 = 0.0f;
+    float t1 = kInfinity;
+    for (int a = 0; a < 3; ++a) {
+        if (std::fabs(d[a]) < 1e-8f) {
+            if (o[a] < -half || o[a] > half)
+                return false;
+            continue;
+        }
+        float tNear = (-half - o[a]) / d[a];
+        float tFar = (half - o[a]) / d[a];
+        if (tNear > tFar)
+            std::swap(tNear, tFar);
+        t0 = std::max(t0, tNear);
+        t1 = std::min(t1, tFar);
+        if (t0 > t1)
+            return false;
+    }
+    *tHit = t0;
+    return true;
+}
+
+/**
+ * @brief Finds the nearest of a set of static cubes hit by a ray.
+ * @param transforms The current cube transforms.
+ * @param origin Ray origin in world space.
+ * @param direction Ray direction in world space (normalized).
+ * @param distance Receives the hit distance (may be nullptr).
+ * @return Index of the nearest cube hit, or -1.
+ */
+int CubePicker::pick(const QList<CubeTransform> &transforms, const QVector3D &origin,
+                     const QVector3D &direction, float *distance)
+{
+    return pick(transforms, QList<CubeAnimation>(), 0, origin, direction, distance);
+}
+
+/**
+ * @brief Finds the nearest cube hit by a ray at an animation time.
+ * @param transforms The static cube transforms.
+ * @param animations Empty, or one animation per cube. Pass the same kind of list on every
+ * call, or reset() the picker when switching, since the bounds are fitted to it.
+ * @param ticks The animation time.
+ * @param origin Ray origin in world space.
+ * @param direction Ray direction in world space (normalized).
+ * @param distance Receives the hit distance (may be nullptr).
+ * @return Index of the nearest cube hit, or -1.
+ *
+ * Traversal visits the nearer child first and prunes nodes whose entry distance is beyond
+ * the closest exact hit found so far. The bounds do not depend on ticks; only the cubes of
+ * the leaves the ray reaches are posed with CubeAnimation::at() for the exact test.
+ */
+int CubePicker::pick(const QList<CubeTransform> &transforms, const QList<CubeAnimation> &animations,
+                     qint64 ticks, const QVector3D &origin, const QVector3D &direction, float *distance)
+{
+    refit(transforms, animations);
+    if (builtCount <= 0)
+        return -1;
+
+    Ray ray;
+    ray.origin = origin;
+    ray.direction = direction;
+    for (int a = 0; a < 3; ++a)
+        ray.invDir[a] = direction[a] != 0.0f ? 1.0f / direction[a] : kInfinity;
+
+    struct StackEntry
+    {
+        int node;
+        float tEntry;
+    };
+
+    int best = -1;
+    float bestT = kInfinity;
+    StackEntry stack[kMaxStackDepth];
+    int top = 0;
+    float tRoot;
+    if (intersectBounds(nodes.at(0), ray, bestT, &tRoot))
+        stack[top++] = {0, tRoot};
+    while (top > 0) {
+        const StackEntry entry = stack[--top];
+        if (entry.tEntry > bestT)
+            continue;
+        const Node &node = nodes.at(entry.node);
+        if (node.count > 0) {
+            for (int i = node.first; i < node.first + node.count; ++i) {
+                const int prim = primIndices.at(i);
+                const CubeTransform &base = transforms.at(prim);
+                const CubeTransform pose = animations.isEmpty() ? base : animations.at(prim).at(base, ticks);
+                float tHit;
+                if (intersectCube(pose, ray, &tHit) && tHit < bestT) {
+                    bestT = tHit;
+                    best = prim;
+                }
+            }
+            continue;
+        }
+        float tLeft, tRight;
+        const bool hitLeft = intersectBounds(nodes.at(node.first), ray, bestT, &tLeft);
+        const bool hitRight = intersectBounds(nodes.at(node.first + 1), ray, bestT, &tRight);
+        Q_ASSERT(top + 2 <= kMaxStackDepth);
+        if (hitLeft && hitRight) {
+            // Push the farther child first so the nearer one is visited next.
+            const bool leftFirst = tLeft < tRight;
+            stack[top++] = leftFirst ? StackEntry{node.first + 1, tRight} : StackEntry{node.first, tLeft};
+            stack[top++] = leftFirst ? StackEntry{node.first, tLeft} : StackEntry{node.first + 1, tRight};
+        } else if (hitLeft) {
+            stack[top++] = {node.first, tLeft};
+        } else if (hitRight) {
+            stack[top++] = {node.first + 1, tRight};
+        }
+    }
+    if (distance)
+        *distance = bestT;
+    return best;
+}
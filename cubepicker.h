@@ -0,0 +1,63 @@
+#ifndef CUBEPICKER_H
+#define CUBEPICKER_H
+
+#include <QList>
+#include <QVector3D>
+#include "cubeinstance.h"
+
+class CubePicker
+{
+public:
+    CubePicker();
+
+    void invalidate(int begin, int end);
+    void reset();
+    int pick(const QList<CubeTransform> &transforms, const QVector3D &origin,
+             const QVector3D &direction, float *distance = nullptr);
+    int pick(const QList<CubeTransform> &transforms, const QList<CubeAnimation> &animations,
+             qint64 ticks, const QVector3D &origin, const QVector3D &direction,
+             float *distance = nullptr);
+
+    int nodeCount() const { return nodes.size(); }
+
+private:
+    /// BVH node. Leaves have count > 0 and reference primitives [first, first + count);
+    /// internal nodes have count == 0 and children at first and first + 1.
+    struct Node
+    {
+        float bmin[3];
+        int first;
+        float bmax[3];
+        int count;
+    };
+
+    struct Ray
+    {
+        QVector3D origin;
+        QVector3D direction;
+        float invDir[3];
+    };
+
+    void rebuild(const QList<CubeTransform> &transforms, const QList<CubeAnimation> &animations);
+    void buildNode(const QList<CubeTransform> &transforms, const QList<CubeAnimation> &animations,
+                   int nodeIndex, int first, int count, int depth);
+    void refitNode(const QList<CubeTransform> &transforms, const QList<CubeAnimation> &animations,
+                   int nodeIndex);
+    void refit(const QList<CubeTransform> &transforms, const QList<CubeAnimation> &animations);
+    static void cubeBounds(const CubeTransform &t, float bmin[3], float bmax[3]);
+    static void sweptBounds(const CubeTransform &t, const CubeAnimation &animation, float bmin[3],
+                            float bmax[3]);
+    static bool intersectBounds(const Node &node, const Ray &ray, float tMax, float *tEntry);
+    static bool intersectCube(const CubeTransform &t, const Ray &ray, float *tHit);
+
+    QList<Node> nodes;
+    QList<int> parents;
+    QList<int> primIndices;
+    QList<int> leafOfPrim;
+    QList<QVector3D> centroids;
+    int builtCount;
+    int treeDepth; ///< Levels of the built tree; bounds the traversal stack.
+    int dirtyBegin, dirtyEnd;
+};
+
+#endif // CUBEPICKER_H
@@ -0,0 +1,616 @@
+/**
+ * @file cuberenderer.cpp
+ * @brief Implementation of the CubeRenderer class.
+ *
+ * CubeRenderer compiles the cube shaders, owns the vertex, instance and texture objects and
+ * the clustered light textures, and draws a CubeScene through the render queue. It is used by
+ * CubeWidget inside the widget's GL context and by RenderServer inside an offscreen context,
+ * so both produce identical images for the same scene.
+ */
+
+#include "cuberenderer.h"
+#include "cubescene.h"
+#include "ktxfile.h"
+#include <QOpenGLContext>
+#include <QOpenGLShader>
+#include <QImage>
+#include <QDebug>
+#include <algorithm>
+
+/**
+ * @brief Constructs a renderer; GL resources are created by initialize().
+ */
+CubeRenderer::CubeRenderer()
+    : textureArray(nullptr),
+      layerCount(0),
+      frameScene(nullptr),
+      uploadedInstances(-1),
+      uploadedAnimations(-1),
+      animatedTicks(-1),
+      uploadedLightsRevision(0),
+      cubeProgramId(-1),
+      cubeVaoId(-1),
+      animatedVaoId(-1),
+      textureArrayId(-1)
+{
+}
+
+/**
+ * @brief Destroys the renderer. destroy() must have been called with the context current.
+ */
+CubeRenderer::~CubeRenderer()
+{
+}
+
+/**
+ * @brief Creates the GL resources. The target context must be current.
+ *
+ * This function performs the following:
+ * - Initializes OpenGL function pointers.
+ * - Sets the clear color (background color set to #456990).
+ * - Enables depth testing and back-face culling.
+ * - Compiles and links the vertex and fragment shaders.
+ *   The vertex shader handles transformations and passes normals and texture coordinates.
+ *   The fragment shader applies Phong lighting and a configurable gloss effect.
+ * - Creates and uploads cube vertex data (positions, normals, texture coordinates) to the GPU.
+ * - Compiles the transform feedback program that animates the cube transforms.
+ * - Creates the per-instance buffers (transform and texture phase) with attribute divisors,
+ *   and the animation buffers with one VAO for the static and one for the animated transforms.
+ * - Loads the cube texture array from the Qt resource system, from the baked KTX file if
+ *   present and supported, otherwise from the PNG strip.
+ * - Allocates the textures holding the clustered light data.
+ * - Registers the program, VAO and textures with the render queue.
+ */
+void CubeRenderer::initialize()
+{
+    initializeOpenGLFunctions();
+    glClearColor(0.27f, 0.41f, 0.56f, 1.0f);  // Background color: #456990
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_BACK);
+
+    const char *vertexSrc = R"(
+        #version 330 core
+        layout(location = 0) in vec3 position;
+        layout(location = 1) in vec3 normal;
+        layout(location = 2) in vec2 texCoord;
+        layout(location = 3) in vec4 instancePosScale;
+        layout(location = 4) in vec4 instanceOrientation;
+        layout(location = 5) in uint instancePhase;
+        uniform mat4 mvp;
+        uniform mat4 model;
+        uniform int uFramePhase;
+        uniform int uTextureLayers;
+        uniform int uHoveredInstance;
+        out vec3 fragPos;
+        out vec3 fragNormal;
+        out vec2 vTexCoord;
+        out vec4 clipPos;
+        flat out float vLayer;
+        flat out float vHighlight;
+        // Rotates v by the unit quaternion q (x, y, z, w).
+        vec3 rotate(vec4 q, vec3 v){
+            return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+        }
+        void main(){
+            vec3 local = rotate(instanceOrientation, position * instancePosScale.w) + instancePosScale.xyz;
+            vec4 worldPos = model * vec4(local, 1.0);
+            fragPos = worldPos.xyz;
+            fragNormal = mat3(transpose(inverse(model))) * rotate(instanceOrientation, normal);
+            vTexCoord = texCoord;
+            vLayer = float((uint(uFramePhase) + instancePhase) % uint(max(uTextureLayers, 1)));
+            vHighlight = gl_InstanceID == uHoveredInstance ? 1.0 : 0.0;
+            gl_Position = mvp * vec4(local, 1.0);
+            clipPos = gl_Position;
+        }
+    )";
+
+    const char *fragmentSrc = R"(
+        #version 330 core
+        in vec3 fragPos;
+        in vec3 fragNormal;
+        in vec2 vTexCoord;
+        in vec4 clipPos;
+        flat in float vLayer;
+        flat in float vHighlight;
+        uniform sampler2DArray textureSampler;
+        uniform vec3 lightDir;
+        uniform vec3 viewPos;
+        uniform bool uGlossOn;
+        uniform sampler2D uLightData;
+        uniform usampler2D uClusterGrid;
+        uniform usampler2D uLightIndices;
+        uniform ivec3 uClusterDims;
+        uniform vec2 uClusterDepth;
+        uniform int uIndexRowWidth;
+        out vec4 fragColor;
+
+        vec3 norm;
+        vec3 viewDir;
+        vec3 baseRgb;
+        float glossFactor;
+
+        // Diffuse + specular contribution of one light arriving from direction 'light'.
+        vec3 shade(vec3 light, vec3 radiance){
+            float diff = max(dot(norm, light), 0.0);
+            vec3 reflectDir = reflect(-light, norm);
+            float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32.0);
+            return radiance * (diff * baseRgb + vec3(spec * glossFactor * 0.5));
+        }
+
+        void main(){
+            vec4 baseColor = texture(textureSampler, vec3(vTexCoord, vLayer));
+            baseRgb = baseColor.rgb;
+            norm = normalize(fragNormal);
+            viewDir = normalize(viewPos - fragPos);
+            glossFactor = 0.0;
+            if(uGlossOn) {
+                float sum = baseColor.r + baseColor.g + baseColor.b;
+                glossFactor = smoothstep(1.1216, 1.8588, sum);
+            }
+            vec3 ambient = 0.2 * baseRgb;
+            vec3 result = ambient + shade(normalize(-lightDir), vec3(1.0));
+
+            // Clustered point and spot lights: only the lights binned into this
+            // fragment's cluster are evaluated.
+            vec2 ndc = clipPos.xy / clipPos.w;
+            ivec2 tile = clamp(ivec2((ndc * 0.5 + 0.5) * vec2(uClusterDims.xy)),
+                               ivec2(0), uClusterDims.xy - 1);
+            int slice = clamp(int(floor(log(clipPos.w) * uClusterDepth.x + uClusterDepth.y)),
+                              0, uClusterDims.z - 1);
+            uvec2 cluster = texelFetch(uClusterGrid, ivec2(tile.x + tile.y * uClusterDims.x, slice), 0).xy;
+            for (uint i = 0u; i < cluster.y; ++i) {
+                int index = int(cluster.x + i);
+                int id = int(texelFetch(uLightIndices, ivec2(index % uIndexRowWidth, index / uIndexRowWidth), 0).r);
+                vec4 posRange = texelFetch(uLightData, ivec2(0, id), 0);
+                vec4 colorIntensity = texelFetch(uLightData, ivec2(1, id), 0);
+                vec4 dirType = texelFetch(uLightData, ivec2(2, id), 0);
+                vec4 cone = texelFetch(uLightData, ivec2(3, id), 0);
+                vec3 toLight = posRange.xyz - fragPos;
+                float dist = length(toLight);
+                vec3 light = toLight / max(dist, 1e-4);
+                float falloff = clamp(1.0 - pow(dist / posRange.w, 4.0), 0.0, 1.0);
+                float attenuation = falloff * falloff / (dist * dist + 1.0);
+                if (dirType.w > 0.5)
+                    attenuation *= smoothstep(cone.y, cone.x, dot(-light, dirType.xyz));
+                result += shade(light, colorIntensity.rgb * colorIntensity.a * attenuation);
+            }
+            result += vHighlight * vec3(0.15);
+            fragColor = vec4(result, 1.0);
+        }
+    )";
+
+    shaderProgram.addShaderFromSourceCode(QOpenGLShader::Vertex, vertexSrc);
+    shaderProgram.addShaderFromSourceCode(QOpenGLShader::Fragment, fragmentSrc);
+    shaderProgram.link();
+
+    // Cube vertex data: each vertex has 8 floats (3 position, 3 normal, 2 texCoords)
+    GLfloat vertices[] = {
+        // Front face (normal: 0,0,1)
+        -0.5f, -0.5f,  0.5f,    0, 0, 1,    0.0f, 0.0f,
+         0.5f, -0.5f,  0.5f,    0, 0, 1,    1.0f, 0.0f,
+         0.5f,  0.5f,  0.5f,    0, 0, 1,    1.0f, 1.0f,
+         0.5f,  0.5f,  0.5f,    0, 0, 1,    1.0f, 1.0f,
+        -0.5f,  0.5f,  0.5f,    0, 0, 1,    0.0f, 1.0f,
+        -0.5f, -0.5f,  0.5f,    0, 0, 1,    0.0f, 0.0f,
+        // Back face (normal: 0,0,-1)
+        -0.5f, -0.5f, -0.5f,    0, 0, -1,   1.0f, 0.0f,
+        -0.5f,  0.5f, -0.5f,    0, 0, -1,   1.0f, 1.0f,
+         0.5f,  0.5f, -0.5f,    0, 0, -1,   0.0f, 1.0f,
+         0.5f,  0.5f, -0.5f,    0, 0, -1,   0.0f, 1.0f,
+         0.5f, -0.5f, -0.5f,    0, 0, -1,   0.0f, 0.0f,
+        -0.5f, -0.5f, -0.5f,    0, 0, -1,   1.0f, 0.0f,
+        // Left face (normal: -1,0,0)
+        -0.5f,  0.5f,  0.5f,   -1, 0, 0,    1.0f, 0.0f,
+        -0.5f,  0.5f, -0.5f,   -1, 0, 0,    1.0f, 1.0f,
+        -0.5f, -0.5f, -0.5f,   -1, 0, 0,    0.0f, 1.0f,
+        -0.5f, -0.5f, -0.5f,   -1, 0, 0,    0.0f, 1.0f,
+        -0.5f, -0.5f,  0.5f,   -1, 0, 0,    0.0f, 0.0f,
+        -0.5f,  0.5f,  0.5f,   -1, 0, 0,    1.0f, 0.0f,
+        // Right face (normal: 1,0,0)
+         0.5f,  0.5f,  0.5f,    1, 0, 0,    1.0f, 0.0f,
+         0.5f, -0.5f, -0.5f,    1, 0, 0,    0.0f, 1.0f,
+         0.5f,  0.5f, -0.5f,    1, 0, 0,    1.0f, 1.0f,
+         0.5f, -0.5f, -0.5f,    1, 0, 0,    0.0f, 1.0f,
+         0.5f,  0.5f,  0.5f,    1, 0, 0,    1.0f, 0.0f,
+         0.5f, -0.5f,  0.5f,    1, 0, 0,    0.0f, 0.0f,
+        // Top face (normal: 0,1,0)
+        -0.5f,  0.5f, -0.5f,    0,1,0,    0.0f, 1.0f,
+        -0.5f,  0.5f,  0.5f,    0,1,0,    0.0f, 0.0f,
+         0.5f,  0.5f,  0.5f,    0,1,0,    1.0f, 0.0f,
+         0.5f,  0.5f,  0.5f,    0,1,0,    1.0f, 0.0f,
+         0.5f,  0.5f, -0.5f,    0,1,0,    1.0f, 1.0f,
+        -0.5f,  0.5f, -0.5f,    0,1,0,    0.0f, 1.0f,
+        // Bottom face (normal: 0,-1,0)
+        -0.5f, -0.5f, -0.5f,    0,-1,0,   1.0f, 1.0f,
+         0.5f, -0.5f, -0.5f,    0,-1,0,   0.0f, 1.0f,
+         0.5f, -0.5f,  0.5f,    0,-1,0,   0.0f, 0.0f,
+         0.5f, -0.5f,  0.5f,    0,-1,0,   0.0f, 0.0f,
+        -0.5f, -0.5f,  0.5f,    0,-1,0,   1.0f, 0.0f,
+        -0.5f, -0.5f, -0.5f,    0,-1,0,   1.0f, 1.0f
+    };
+
+    // Transform feedback pass: computes the animated transform of every cube from its static
+    // transform (attributes 0, 1) and its CubeAnimation (attributes 2, 3), one point per cube.
+    const char *animationSrc = R"(
+        #version 330 core
+        layout(location = 0) in vec4 basePosScale;
+        layout(location = 1) in vec4 baseOrientation;
+        layout(location = 2) in vec4 pivotSpeed;
+        layout(location = 3) in vec4 axisMode;
+        uniform uint uAnimTicks;
+        out vec4 outPosScale;
+        out vec4 outOrientation;
+        // Hamilton product of two quaternions stored as (x, y, z, w).
+        vec4 qmul(vec4 a, vec4 b){
+            return vec4(a.w * b.xyz + b.w * a.xyz + cross(a.xyz, b.xyz), a.w * b.w - dot(a.xyz, b.xyz));
+        }
+        vec3 rotate(vec4 q, vec3 v){
+            return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+        }
+        void main(){
+            // Fixed-point phase as in CubeAnimation::at(): 2^-32 turns per unit, wrapping
+            // modulo one turn, so the clock never loses precision.
+            float turns = pivotSpeed.w * (1.0 / 360.0);
+            float turnStep = floor((turns - floor(turns)) * 4294967296.0 + 0.5);
+            uint phase = (turnStep >= 4294967296.0 ? 0u : uint(turnStep)) * uAnimTicks;
+            float halfAngle = 0.5 * radians(float(phase) * (360.0 / 4294967296.0));
+            vec4 r = vec4(axisMode.xyz * sin(halfAngle), cos(halfAngle));
+            if (axisMode.w > 0.5) {
+                // Rotation about the world-space line through pivotSpeed.xyz.
+                outPosScale = vec4(pivotSpeed.xyz + rotate(r, basePosScale.xyz - pivotSpeed.xyz), basePosScale.w);
+                outOrientation = normalize(qmul(r, baseOrientation));
+            } else {
+                // Spin about the cube's own center, axis in the cube's local frame.
+                outPosScale = basePosScale;
+                outOrientation = normalize(qmul(baseOrientation, r));
+            }
+        }
+    )";
+
+    animationProgram.addShaderFromSourceCode(QOpenGLShader::Vertex, animationSrc);
+    const char *varyings[] = {"outPosScale", "outOrientation"};
+    glTransformFeedbackVaryings(animationProgram.programId(), 2, varyings, GL_INTERLEAVED_ATTRIBS);
+    animationProgram.link();
+
+    vbo.create();
+    vbo.bind();
+    vbo.allocate(vertices, sizeof(vertices));
+    instanceVbo.create();
+    instanceVbo.setUsagePattern(QOpenGLBuffer::DynamicDraw);
+    phaseVbo.create();
+    animationVbo.create();
+    animatedVbo.create();
+    animatedVbo.setUsagePattern(QOpenGLBuffer::DynamicCopy);
+    shaderProgram.bind();
+    setupCubeVao(vao, instanceVbo);
+    setupCubeVao(animatedVao, animatedVbo);
+
+    animationVao.create();
+    animationVao.bind();
+    instanceVbo.bind();
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(CubeTransform), nullptr);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(CubeTransform),
+                          reinterpret_cast<const void *>(4 * sizeof(GLfloat)));
+    animationVbo.bind();
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(CubeAnimation), nullptr);
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(CubeAnimation),
+                          reinterpret_cast<const void *>(4 * sizeof(GLfloat)));
+    animationVao.release();
+    uploadedInstances = -1;
+    uploadedAnimations = -1;
+    animatedTicks = -1;
+    uploadedLightsRevision = ~quint64(0);
+
+    // Prefer the baked KTX texture (mip chain, possibly compressed) and fall back to decoding
+    // the PNG strip when it is missing or the GPU cannot sample its format.
+    textureArray = loadBakedTexture(":/textures/textures/texture.ktx");
+    if (!textureArray)
+        textureArray = loadTextureStrip(":/textures/textures/texture.png");
+
+    clusteredLights.initializeGL();
+
+    // Register the GL objects with the render queue; per-frame program uniforms are set
+    // once, when the queue first binds the program.
+    renderQueue.clearRegistrations();
+    cubeProgramId = renderQueue.registerProgram(&shaderProgram, [this](QOpenGLShaderProgram &program) {
+        program.setUniformValue("viewPos", frameScene->cameraPosition());
+        program.setUniformValue("lightDir", frameScene->lightDirection());
+        program.setUniformValue("uGlossOn", frameScene->glossEnabled());
+        program.setUniformValue("textureSampler", 0);
+        program.setUniformValue("uFramePhase", frameScene->textureFrame());
+        program.setUniformValue("uTextureLayers", layerCount);
+        program.setUniformValue("uHoveredInstance", frameScene->hoveredIndex());
+        clusteredLights.bind(program, 1);
+    });
+    cubeVaoId = renderQueue.registerVao(&vao);
+    animatedVaoId = renderQueue.registerVao(&animatedVao);
+    textureArrayId = textureArray ? renderQueue.registerTexture(textureArray) : -1;
+}
+
+/**
+ * @brief Creates a VAO drawing the cube mesh once per instance.
+ * @param target The VAO to set up.
+ * @param transforms Buffer holding one CubeTransform per instance (static or animated).
+ */
+void CubeRenderer::setupCubeVao(QOpenGLVertexArrayObject &target, QOpenGLBuffer &transforms)
+{
+    target.create();
+    target.bind();
+    vbo.bind();
+    // Set vertex attribute 0: position (3 floats)
+    shaderProgram.enableAttributeArray(0);
+    shaderProgram.setAttributeBuffer(0, GL_FLOAT, 0, 3, 8 * sizeof(GLfloat));
+    // Set vertex attribute 1: normal (3 floats)
+    shaderProgram.enableAttributeArray(1);
+    shaderProgram.setAttributeBuffer(1, GL_FLOAT, 3 * sizeof(GLfloat), 3, 8 * sizeof(GLfloat));
+    // Set vertex attribute 2: texture coordinates (2 floats)
+    shaderProgram.enableAttributeArray(2);
+    shaderProgram.setAttributeBuffer(2, GL_FLOAT, 6 * sizeof(GLfloat), 2, 8 * sizeof(GLfloat));
+    // Per-instance attributes 3 and 4: position/scale and orientation (CubeTransform)
+    transforms.bind();
+    shaderProgram.enableAttributeArray(3);
+    shaderProgram.setAttributeBuffer(3, GL_FLOAT, 0, 4, sizeof(CubeTransform));
+    shaderProgram.enableAttributeArray(4);
+    shaderProgram.setAttributeBuffer(4, GL_FLOAT, 4 * sizeof(GLfloat), 4, sizeof(CubeTransform));
+    glVertexAttribDivisor(3, 1);
+    glVertexAttribDivisor(4, 1);
+    // Per-instance attribute 5: texture phase offset (integer attribute)
+    phaseVbo.bind();
+    glEnableVertexAttribArray(5);
+    glVertexAttribIPointer(5, 1, GL_UNSIGNED_INT, sizeof(quint32), nullptr);
+    glVertexAttribDivisor(5, 1);
+    target.release();
+}
+
+/**
+ * @brief Returns true if the current context can sample textures of the given KTX format.
+ */
+static bool isFormatSupported(quint32 internalFormat)
+{
+    const QOpenGLContext *context = QOpenGLContext::currentContext();
+    switch (internalFormat) {
+    case KtxFormat::Rgba8:
+        return true;
+    case KtxFormat::CompressedRgbS3tcDxt1:
+        return context->hasExtension("GL_EXT_texture_compression_s3tc");
+    case KtxFormat::CompressedRgb8Etc2:
+        // Core in OpenGL ES 3.0 and OpenGL 4.3.
+        return context->isOpenGLES() ? context->format().majorVersion() >= 3
+                                     : context->format().version() >= qMakePair(4, 3)
+                                           || context->hasExtension("GL_ARB_ES3_compatibility");
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief Creates the cube texture array from a KTX file written by the texbaker tool.
+ * @return The texture, or nullptr if the file is missing, invalid or not supported by the GPU.
+ *
+ * Every mip level of every layer is uploaded straight from the mapped file, without decoding.
+ */
+QOpenGLTexture *CubeRenderer::loadBakedTexture(const QString &path)
+{
+    if (!QFile::exists(path))
+        return nullptr;
+    KtxFile ktx;
+    if (!ktx.open(path)) {
+        qDebug() << "Error loading baked texture" << path << ":" << ktx.errorString();
+        return nullptr;
+    }
+    const quint32 internalFormat = ktx.header().glInternalFormat;
+    if (!isFormatSupported(internalFormat)) {
+        qDebug() << "Baked texture format" << Qt::hex << internalFormat << "is not supported, using the PNG";
+        return nullptr;
+    }
+
+    QOpenGLTexture *texture = new QOpenGLTexture(QOpenGLTexture::Target2DArray);
+    texture->setFormat(QOpenGLTexture::TextureFormat(internalFormat));
+    texture->setSize(ktx.width(0), ktx.height(0));
+    texture->setLayers(ktx.layers());
+    texture->setMipLevels(ktx.levelCount());
+    texture->allocateStorage(QOpenGLTexture::RGBA, QOpenGLTexture::UInt8);
+    for (int level = 0; level < ktx.levelCount(); ++level) {
+        for (int layer = 0; layer < ktx.layers(); ++layer) {
+            qint64 bytes = 0;
+            const uchar *data = ktx.layerData(level, layer, &bytes);
+            if (KtxFormat::isCompressed(internalFormat))
+                texture->setCompressedData(level, layer, int(bytes), data);
+            else
+                texture->setData(level, layer, QOpenGLTexture::RGBA, QOpenGLTexture::UInt8, data);
+        }
+    }
+    // Trilinear minification removes the aliasing of distant cubes; magnification stays
+    // Nearest so close-ups keep the pixel-art look.
+    texture->setMinificationFilter(ktx.levelCount() > 1 ? QOpenGLTexture::LinearMipMapLinear
+                                                        : QOpenGLTexture::Nearest);
+    texture->setMagnificationFilter(QOpenGLTexture::Nearest);
+    texture->setWrapMode(QOpenGLTexture::ClampToEdge);
+    layerCount = ktx.layers();
+    return texture;
+}
+
+/**
+ * @brief Creates the cube texture array from a PNG holding the 16x16 phases stacked
+ * vertically; each phase becomes one layer, so every instance can sample its own phase.
+ * @return The texture, or nullptr if the image cannot be loaded.
+ */
+QOpenGLTexture *CubeRenderer::loadTextureStrip(const QString &path)
+{
+    QImage fullImage(path);
+    if (fullImage.isNull()) {
+        qDebug() << "Error loading texture";
+        return nullptr;
+    }
+    layerCount = fullImage.height() / 16;
+    QOpenGLTexture *texture = new QOpenGLTexture(QOpenGLTexture::Target2DArray);
+    texture->setFormat(QOpenGLTexture::RGBA8_UNorm);
+    texture->setSize(16, 16);
+    texture->setLayers(layerCount);
+    texture->setMipLevels(1);
+    texture->allocateStorage(QOpenGLTexture::RGBA, QOpenGLTexture::UInt8);
+    for (int i = 0; i < layerCount; ++i) {
+        QImage sub = fullImage.copy(0, i * 16, 16, 16).mirrored().convertToFormat(QImage::Format_RGBA8888);
+        texture->setData(0, i, QOpenGLTexture::RGBA, QOpenGLTexture::UInt8, sub.constBits());
+    }
+    texture->setMinificationFilter(QOpenGLTexture::Nearest);
+    texture->setMagnificationFilter(QOpenGLTexture::Nearest);
+    texture->setWrapMode(QOpenGLTexture::ClampToEdge);
+    return texture;
+}
+
+/**
+ * @brief Releases the GL resources. The context they were created in must be current.
+ */
+void CubeRenderer::destroy()
+{
+    vbo.destroy();
+    instanceVbo.destroy();
+    phaseVbo.destroy();
+    animationVbo.destroy();
+    animatedVbo.destroy();
+    vao.destroy();
+    animatedVao.destroy();
+    animationVao.destroy();
+    delete textureArray;
+    textureArray = nullptr;
+    clusteredLights.destroyGL();
+    renderQueue.clearRegistrations();
+}
+
+/**
+ * @brief Sets the viewport and updates the projection matrix for a new target size.
+ * @param w New width.
+ * @param h New height.
+ */
+void CubeRenderer::resize(int w, int h)
+{
+    glViewport(0, 0, w, h);
+    projection.setToIdentity();
+    projection.perspective(FieldOfView, float(w) / std::max(h, 1), NearPlane, FarPlane);
+}
+
+/**
+ * @brief Uploads the scene's dirty instance range to the instance and animation buffers.
+ * @return true if anything was uploaded.
+ *
+ * The buffers are reallocated when the number of cubes (or animations) changed; otherwise only
+ * the dirty range is written, so editing one cube in a large scene uploads 36 bytes (68 with
+ * animations).
+ */
+bool CubeRenderer::uploadInstances(CubeScene &scene)
+{
+    const QList<CubeTransform> &transforms = scene.transforms();
+    const QList<quint32> &phases = scene.texturePhases();
+    const QList<CubeAnimation> &animations = scene.animations();
+    const int count = transforms.size();
+    int begin = 0, end = 0;
+    const bool dirty = scene.takeDirtyInstances(&begin, &end);
+    const bool reallocate = count != uploadedInstances;
+    const bool reallocateAnimations = animations.size() != uploadedAnimations;
+    if (!dirty && !reallocate && !reallocateAnimations)
+        return false;
+
+    const int n = end - begin;
+    if (reallocate) {
+        instanceVbo.bind();
+        instanceVbo.allocate(transforms.constData(), count * int(sizeof(CubeTransform)));
+        phaseVbo.bind();
+        phaseVbo.allocate(phases.constData(), count * int(sizeof(quint32)));
+        uploadedInstances = count;
+    } else if (dirty) {
+        instanceVbo.bind();
+        instanceVbo.write(begin * int(sizeof(CubeTransform)), transforms.constData() + begin,
+                          n * int(sizeof(CubeTransform)));
+        phaseVbo.bind();
+        phaseVbo.write(begin * int(sizeof(quint32)), phases.constData() + begin,
+                       n * int(sizeof(quint32)));
+    }
+    if (reallocateAnimations) {
+        animationVbo.bind();
+        animationVbo.allocate(animations.constData(), animations.size() * int(sizeof(CubeAnimation)));
+        animatedVbo.bind();
+        animatedVbo.allocate(animations.size() * int(sizeof(CubeTransform)));
+        uploadedAnimations = animations.size();
+    } else if (dirty && !animations.isEmpty()) {
+        animationVbo.bind();
+        animationVbo.write(begin * int(sizeof(CubeAnimation)), animations.constData() + begin,
+                           n * int(sizeof(CubeAnimation)));
+    }
+    phaseVbo.release();
+    animatedTicks = -1;
+    return true;
+}
+
+/**
+ * @brief Runs the transform feedback pass writing the animated transforms of all cubes.
+ *
+ * Rasterization is disabled; each cube is one point whose vertex shader output is captured
+ * into animatedVbo, which the draw then uses as its instance buffer. Nothing is read back or
+ * uploaded, so the CPU cost is independent of the number of cubes. Only the low 32 bits of
+ * the animation clock are passed: the fixed-point phase wraps with them.
+ */
+void CubeRenderer::animateInstances(const CubeScene &scene)
+{
+    animationProgram.bind();
+    glUniform1ui(animationProgram.uniformLocation("uAnimTicks"), GLuint(quint32(scene.animationTime())));
+    animationVao.bind();
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, animatedVbo.bufferId());
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, scene.cubeCount());
+    glEndTransformFeedback();
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glDisable(GL_RASTERIZER_DISCARD);
+    animationVao.release();
+    animationProgram.release();
+    animatedTicks = scene.animationTime();
+}
+
+/**
+ * @brief Renders the scene into the currently bound framebuffer.
+ *
+ * This method starts a new frame in the frame arena (scratch memory that callers may keep
+ * using for their own per-frame data until the next render()), clears the target, bins the
+ * clustered lights for the current camera, uploads the dirty instance range, advances
+ * animated cubes with a transform feedback pass (only when the animation time or the
+ * instances changed) and submits all cubes as one instanced draw packet to the render queue.
+ * submitExtra, if set, then adds its own packets (in server mode there are none; the widget
+ * adds its text overlay). The queue sorts the packets, switches the pass state, binds the
+ * shader program (setting the lighting and gloss uniforms once per frame), texture and VAO
+ * only when they change, and issues the draws. After warm-up none of this allocates heap
+ * memory.
+ */
+void CubeRenderer::render(CubeScene &scene, const FrameSubmitter &submitExtra)
+{
+    frameScene = &scene;
+    frameArena.reset();
+    if (scene.lightsRevision() != uploadedLightsRevision) {
+        clusteredLights.setLights(scene.lights());
+        uploadedLightsRevision = scene.lightsRevision();
+    }
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    clusteredLights.build(scene.viewMatrix(), projection, NearPlane, FarPlane, frameArena);
+    renderQueue.setViewProjection(projection * scene.viewMatrix());
+    const bool uploaded = uploadInstances(scene);
+    const bool animated = scene.isAnimated();
+    if (animated && (uploaded || animatedTicks != scene.animationTime()))
+        animateInstances(scene);
+
+    DrawPacket cubes;
+    cubes.key = RenderQueue::makeKey(RenderQueue::Opaque, cubeProgramId, textureArrayId,
+                                     animated ? animatedVaoId : cubeVaoId, 0.0f);
+    cubes.first = 0;
+    cubes.count = 36;
+    cubes.instanceCount = scene.cubeCount();
+    renderQueue.submit(cubes);
+    if (submitExtra)
+        submitExtra(renderQueue, frameArena);
+    renderQueue.flush(this, frameArena);
+    frameScene = nullptr;
+}
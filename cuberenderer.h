@@ -0,0 +1,80 @@
+#ifndef CUBERENDERER_H
+#define CUBERENDERER_H
+
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLBuffer>
+#include <QOpenGLVertexArrayObject>
+#include <QOpenGLTexture>
+#include <QMatrix4x4>
+#include "framearena.h"
+#include "lightcluster.h"
+#include "renderqueue.h"
+#include <functional>
+
+class CubeScene;
+
+/**
+ * @brief Owns the GL resources for drawing a CubeScene and renders it into whatever
+ * framebuffer is bound (the widget's, or an offscreen one in server mode).
+ */
+class CubeRenderer : protected QOpenGLExtraFunctions
+{
+public:
+    static constexpr float FieldOfView = 45.0f;
+    static constexpr float NearPlane = 0.1f;
+    static constexpr float FarPlane = 100.0f;
+
+    /// Submits extra packets (e.g. the text overlay) into the frame before it is flushed.
+    using FrameSubmitter = std::function<void(RenderQueue &queue, FrameArena &arena)>;
+
+    CubeRenderer();
+    ~CubeRenderer();
+
+    void initialize();
+    void destroy();
+    void resize(int w, int h);
+    void render(CubeScene &scene, const FrameSubmitter &submitExtra = FrameSubmitter());
+
+    const QMatrix4x4 &projectionMatrix() const { return projection; }
+    int textureLayers() const { return layerCount; }
+    const ClusteredLights &lights() const { return clusteredLights; }
+    const RenderQueue::Stats &stats() const { return renderQueue.stats(); }
+    FrameArena &arena() { return frameArena; } ///< Valid for the frame until the next render().
+    RenderQueue &queue() { return renderQueue; } ///< For registering the objects of extra packets.
+
+private:
+    void setupCubeVao(QOpenGLVertexArrayObject &target, QOpenGLBuffer &transforms);
+    bool uploadInstances(CubeScene &scene);
+    void animateInstances(const CubeScene &scene);
+    QOpenGLTexture *loadBakedTexture(const QString &path);
+    QOpenGLTexture *loadTextureStrip(const QString &path);
+
+    QOpenGLShaderProgram shaderProgram;
+    QOpenGLShaderProgram animationProgram; ///< Transform feedback pass, no fragment stage.
+    QOpenGLBuffer vbo { QOpenGLBuffer::VertexBuffer };
+    QOpenGLBuffer instanceVbo { QOpenGLBuffer::VertexBuffer };
+    QOpenGLBuffer phaseVbo { QOpenGLBuffer::VertexBuffer };
+    QOpenGLBuffer animationVbo { QOpenGLBuffer::VertexBuffer };
+    QOpenGLBuffer animatedVbo { QOpenGLBuffer::VertexBuffer };
+    QOpenGLVertexArrayObject vao;          ///< Draws the static transforms.
+    QOpenGLVertexArrayObject animatedVao;  ///< Draws the transform feedback output.
+    QOpenGLVertexArrayObject animationVao; ///< Feeds the transform feedback pass.
+    QOpenGLTexture *textureArray;
+    int layerCount;
+    QMatrix4x4 projection;
+    ClusteredLights clusteredLights;
+    RenderQueue renderQueue;
+    FrameArena frameArena;
+    const CubeScene *frameScene; ///< Scene being rendered, read by the program setup.
+    int uploadedInstances;
+    int uploadedAnimations;
+    qint64 animatedTicks; ///< Animation time of the animatedVbo contents, or -1.
+    quint64 uploadedLightsRevision;
+    int cubeProgramId;
+    int cubeVaoId;
+    int animatedVaoId;
+    int textureArrayId;
+};
+
+#endif // CUBERENDERER_H
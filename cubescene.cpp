@@ -0,0 +1,416 @@
+/**
+ * @file cubescene.cpp
+ * @brief Implementation of the CubeScene class.
+ *
+ * CubeScene holds the state that is rendered (cube transforms and texture phases, camera,
+ * gloss toggle, directional and clustered lights) together with the operations on it, so the
+ * same scene can be driven by the interactive widget or by the headless render server. It
+ * owns no GL objects: the renderer pulls the dirty instance range and the light revision
+ * before each frame.
+ *
+ * Animated cubes keep their static transform; the animated pose is a function of that
+ * transform, the cube's CubeAnimation and the elapsed ticks, evaluated on the GPU every frame.
+ * Advancing the animation is therefore just a counter increment. The poses are baked back
+ * into the transforms on the CPU only when something needs them (editing, picking, saving).
+ */
+
+#include "cubescene.h"
+#include "scenefile.h"
+#include <QColor>
+#include <QRandomGenerator>
+#include <QtMath>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace {
+constexpr int kScatteredLightCount = 256;
+}
+
+/**
+ * @brief Constructs the default scene: one cube at the origin seen from (0, 0, 3).
+ */
+CubeScene::CubeScene()
+    : animationTicks(0),
+      lightsVersion(0),
+      dirtyBegin(0),
+      dirtyEnd(0),
+      distance(3.0f),
+      gloss(true),
+      lightDir(0.0f, 0.0f, -1.0f),
+      textureFrameIndex(0),
+      selected(0),
+      hovered(-1)
+{
+    resetDefault();
+}
+
+/**
+ * @brief Resets the scene and camera to the default view.
+ *
+ * Sets the camera at (0,0,3) looking at the origin, and replaces the scene with a single
+ * cube at the origin with an identity transform.
+ */
+void CubeScene::resetDefault()
+{
+    setViewPosition(QVector3D(0, 0, 3.0f), QVector3D(0, 0, 0));
+    cubeTransforms = {CubeTransform::identity()};
+    phases = {0u};
+    cubeAnimations.clear();
+    animationTicks = 0;
+    selected = 0;
+    hovered = -1;
+    picker.reset();
+    markInstancesDirty(0, 1);
+}
+
+/**
+ * @brief Replaces the current scene with the contents of a scene file.
+ * @param path Path of the scene file.
+ * @param errorMessage Receives the reason on failure (may be nullptr).
+ * @return true if the scene was loaded.
+ *
+ * The file is memory-mapped; the cube transforms and texture phases are copied in bulk into
+ * the instance arrays (their layout is identical to the file's) and uploaded on the next
+ * frame. Camera, gloss and light setup are restored from the settings and lights sections,
+ * and per-cube animations from the optional animations section.
+ */
+bool CubeScene::load(const QString &path, QString *errorMessage)
+{
+    MappedScene scene;
+    if (!scene.open(path)) {
+        if (errorMessage)
+            *errorMessage = scene.errorString();
+        return false;
+    }
+    qint64 count = 0;
+    const CubeTransform *sceneTransforms = scene.transforms(&count);
+    if (count <= 0 || count > std::numeric_limits<int>::max() / qint64(sizeof(CubeTransform))) {
+        if (errorMessage)
+            *errorMessage = "The scene contains no cubes or too many cubes";
+        return false;
+    }
+
+    cubeTransforms.resize(count);
+    std::memcpy(cubeTransforms.data(), sceneTransforms, count * sizeof(CubeTransform));
+    qint64 phaseCount = 0;
+    const quint32 *scenePhases = scene.texturePhases(&phaseCount);
+    phases.resize(count);
+    if (phaseCount == count)
+        std::memcpy(phases.data(), scenePhases, count * sizeof(quint32));
+    else
+        std::fill(phases.begin(), phases.end(), 0u);
+
+    qint64 animationCount = 0;
+    const CubeAnimation *sceneAnimations = scene.animations(&animationCount);
+    if (animationCount == count)
+        cubeAnimations = QList<CubeAnimation>(sceneAnimations, sceneAnimations + count);
+    else
+        cubeAnimations.clear();
+    animationTicks = 0;
+
+    qint64 lightCount = 0;
+    const Light *sceneLights = scene.lights(&lightCount);
+    setLights(sceneLights ? QList<Light>(sceneLights, sceneLights + lightCount) : QList<Light>());
+
+    if (const SceneFormat::SceneSettings *settings = scene.settings()) {
+        setViewPosition(QVector3D(settings->eye[0], settings->eye[1], settings->eye[2]),
+                        QVector3D(settings->target[0], settings->target[1], settings->target[2]));
+        distance = settings->cameraDistance;
+        gloss = settings->glossEnabled != 0;
+        lightDir = QVector3D(settings->lightDirection[0], settings->lightDirection[1],
+                             settings->lightDirection[2]);
+    }
+
+    selected = 0;
+    hovered = -1;
+    picker.reset();
+    markInstancesDirty(0, cubeTransforms.size());
+    return true;
+}
+
+/**
+ * @brief Writes the scene (cubes, texture phases, animations, camera and lights) to a file.
+ * @param path Path of the scene file.
+ * @param errorMessage Receives the reason on failure (may be nullptr).
+ * @return true if the scene was saved.
+ *
+ * A running animation is saved at its current pose.
+ */
+bool CubeScene::save(const QString &path, QString *errorMessage) const
+{
+    SceneFormat::SceneSettings settings;
+    std::memset(&settings, 0, sizeof(settings));
+    settings.eye[0] = camPos.x();
+    settings.eye[1] = camPos.y();
+    settings.eye[2] = camPos.z();
+    settings.cameraDistance = distance;
+    settings.target[0] = camTarget.x();
+    settings.target[1] = camTarget.y();
+    settings.target[2] = camTarget.z();
+    settings.glossEnabled = gloss ? 1u : 0u;
+    settings.lightDirection[0] = lightDir.x();
+    settings.lightDirection[1] = lightDir.y();
+    settings.lightDirection[2] = lightDir.z();
+
+    QList<CubeTransform> posed;
+    if (isAnimated()) {
+        posed.reserve(cubeTransforms.size());
+        for (int i = 0; i < cubeTransforms.size(); ++i)
+            posed.append(transformAt(i));
+    }
+    const QList<CubeTransform> &transforms = posed.isEmpty() ? cubeTransforms : posed;
+
+    SceneWriter writer(path);
+    const bool ok = writer.open()
+            && writer.writeSection(SceneFormat::Settings, sizeof(settings), &settings, 1)
+            && writer.writeSection(SceneFormat::Transforms, sizeof(CubeTransform),
+                                   transforms.constData(), transforms.size())
+            && writer.writeSection(SceneFormat::TexturePhases, sizeof(quint32),
+                                   phases.constData(), phases.size())
+            && writer.writeSection(SceneFormat::Lights, sizeof(Light), lightList.constData(), lightList.size())
+            && (cubeAnimations.isEmpty()
+                || writer.writeSection(SceneFormat::Animations, sizeof(CubeAnimation),
+                                       cubeAnimations.constData(), cubeAnimations.size()))
+            && writer.close();
+    if (!ok && errorMessage)
+        *errorMessage = writer.errorString();
+    return ok;
+}
+
+/**
+ * @brief Sets the view (camera) position.
+ * @param eye The camera position.
+ * @param center The target point the camera is looking at.
+ *
+ * Updates the view matrix using a lookAt transformation and stores the camera
+ * information.
+ */
+void CubeScene::setViewPosition(const QVector3D &eye, const QVector3D &center)
+{
+    view.setToIdentity();
+    view.lookAt(eye, center, QVector3D(0, 1, 0));
+    camPos = eye;
+    camTarget = center;
+    distance = eye.z();
+}
+
+/**
+ * @brief Moves the camera along the Z axis towards or away from the origin.
+ * @param steps Number of half-unit steps; positive values zoom in.
+ *
+ * The camera distance is kept between 1 and 20.
+ */
+void CubeScene::zoom(int steps)
+{
+    distance = std::clamp(distance - steps * 0.5f, 1.0f, 20.0f);
+    view.setToIdentity();
+    view.lookAt(QVector3D(0, 0, distance), QVector3D(0, 0, 0), QVector3D(0, 1, 0));
+    camPos = QVector3D(0, 0, distance);
+}
+
+/**
+ * @brief Rotates one cube about a pivot point.
+ * @param index Index of the cube.
+ * @param rotation The rotation to apply.
+ * @param pivot The point the rotation is about.
+ *
+ * Equivalent to M = T(pivot) * R * T(-pivot) * M_current on the cube's current (animated)
+ * transform. Only this cube is touched: its static transform is rebased (see setPose()) so
+ * that its animation reaches the rotated pose now and continues from there.
+ */
+void CubeScene::rotateInstance(int index, const QQuaternion &rotation, const QVector3D &pivot)
+{
+    if (index < 0 || index >= cubeTransforms.size())
+        return;
+    CubeTransform t = transformAt(index);
+    t.setTranslation(pivot + rotation.rotatedVector(t.translation() - pivot));
+    t.setRotation(rotation * t.rotation());
+    setPose(index, t);
+}
+
+/**
+ * @brief Rotates one cube about an arbitrary line.
+ * @param index Index of the cube.
+ * @param b A point on the line.
+ * @param d The direction of the line.
+ * @param angle The angle (in degrees) by which to rotate.
+ *
+ * The rotation is applied as: M = T(b) * R(angle, normalized(d)) * T(-b) * M_current.
+ */
+void CubeScene::rotateAboutLine(int index, const QVector3D &b, const QVector3D &d, float angle)
+{
+    rotateInstance(index, QQuaternion::fromAxisAndAngle(d.normalized(), angle), b);
+}
+
+/**
+ * @brief Sets the animation of one cube.
+ * @param index Index of the cube.
+ * @param animation Its new animation (CubeAnimation::none() to stop it).
+ *
+ * The animation list is created on first use. The new motion starts from the cube's current
+ * pose; the other cubes are not touched.
+ */
+void CubeScene::setAnimation(int index, const CubeAnimation &animation)
+{
+    if (index < 0 || index >= cubeTransforms.size())
+        return;
+    const CubeTransform pose = transformAt(index);
+    if (cubeAnimations.isEmpty()) {
+        cubeAnimations.fill(CubeAnimation::none(), cubeTransforms.size());
+        markInstancesDirty(0, cubeTransforms.size());
+    }
+    cubeAnimations[index] = animation;
+    setPose(index, pose);
+}
+
+/**
+ * @brief Advances the animation clock.
+ * @param ticks Number of ticks (not negative).
+ *
+ * The clock is never baked while it runs: poses wrap in fixed point (see
+ * CubeAnimation::at()), so a long-running clock costs no precision.
+ */
+void CubeScene::advanceAnimation(qint64 ticks)
+{
+    animationTicks += ticks;
+}
+
+/**
+ * @brief Stops every animation, leaving the cubes at their current poses.
+ */
+void CubeScene::clearAnimations()
+{
+    bakeAnimation();
+    cubeAnimations.clear();
+    picker.invalidate(0, cubeTransforms.size()); // the bounds were swept for the animations
+}
+
+/**
+ * @brief Writes the current animated poses into the transforms and restarts the animation
+ * clock at zero.
+ *
+ * Every cube is re-uploaded and refitted afterwards, so this is only done when animations
+ * are cleared. Edits of single cubes go through
+ * setPose() instead, and transformAt() evaluates poses without changing the scene.
+ */
+void CubeScene::bakeAnimation()
+{
+    if (!isAnimated())
+        return;
+    for (int i = 0; i < cubeTransforms.size(); ++i)
+        cubeTransforms[i] = cubeAnimations.at(i).at(cubeTransforms.at(i), animationTicks);
+    animationTicks = 0;
+    markInstancesDirty(0, cubeTransforms.size());
+}
+
+/**
+ * @brief Returns the current (animated) transform of one cube.
+ */
+CubeTransform CubeScene::transformAt(int index) const
+{
+    if (!isAnimated())
+        return cubeTransforms.at(index);
+    return cubeAnimations.at(index).at(cubeTransforms.at(index), animationTicks);
+}
+
+/**
+ * @brief Moves one cube to a pose at the current animation time.
+ *
+ * The static transform is set to the pose run back by the current animation time, so that
+ * the cube's animation advances it exactly to pose now and continues from there.
+ */
+void CubeScene::setPose(int index, const CubeTransform &pose)
+{
+    cubeTransforms[index] = isAnimated() ? cubeAnimations.at(index).at(pose, -animationTicks)
+                                         : pose;
+    markInstancesDirty(index, index + 1);
+}
+
+/**
+ * @brief Replaces the clustered point and spot lights.
+ * @param lights The new lights (at most ClusteredLights::MaxLights are used by the renderer).
+ */
+void CubeScene::setLights(const QList<Light> &lights)
+{
+    lightList = lights;
+    ++lightsVersion;
+}
+
+/**
+ * @brief Toggles a field of scattered point and spot lights around the cube.
+ *
+ * When enabled, kScatteredLightCount lights with random colors are placed on a shell around
+ * the origin (a fixed seed keeps the layout identical between runs); a quarter of them are
+ * spot lights aimed at the cube. Calling it again removes them.
+ */
+void CubeScene::toggleScatteredLights()
+{
+    if (!lightList.isEmpty()) {
+        setLights(QList<Light>());
+        return;
+    }
+    QRandomGenerator rng(26);
+    QList<Light> lights;
+    lights.reserve(kScatteredLightCount);
+    for (int i = 0; i < kScatteredLightCount; ++i) {
+        const float theta = float(rng.bounded(2.0 * M_PI));
+        const float z = float(rng.bounded(2.0) - 1.0);
+        const float radius = 0.9f + float(rng.bounded(2.5));
+        const float ring = std::sqrt(1.0f - z * z);
+        const QVector3D pos(radius * ring * std::cos(theta), radius * ring * std::sin(theta), radius * z);
+        const QColor c = QColor::fromHsvF(float(rng.bounded(1.0)), 0.8f, 1.0f);
+        const QVector3D color(c.redF(), c.greenF(), c.blueF());
+        const float range = 1.0f + float(rng.bounded(1.0));
+        if (i % 4 == 3)
+            lights.append(Light::spot(pos, -pos, range + 1.0f, 15.0f, 25.0f, color, 1.5f));
+        else
+            lights.append(Light::point(pos, range, color, 0.8f));
+    }
+    setLights(lights);
+}
+
+/**
+ * @brief Finds the nearest cube hit by a world-space ray.
+ * @return Index of the cube, or -1.
+ *
+ * The BVH bounds of animated cubes enclose their whole animation and are only refitted
+ * when a cube or its animation changes, so picking while the clock runs costs no more
+ * than for static cubes plus posing the few candidates the ray reaches.
+ */
+int CubeScene::pick(const QVector3D &origin, const QVector3D &direction, float *hitDistance)
+{
+    return picker.pick(cubeTransforms, cubeAnimations, animationTicks, origin, direction, hitDistance);
+}
+
+/**
+ * @brief Records that a range of instances must be re-uploaded before the next draw and
+ * refitted in the picking BVH before the next pick.
+ * @param begin First dirty instance.
+ * @param end One past the last dirty instance.
+ */
+void CubeScene::markInstancesDirty(int begin, int end)
+{
+    picker.invalidate(begin, end);
+    if (dirtyEnd <= dirtyBegin) {
+        dirtyBegin = begin;
+        dirtyEnd = end;
+    } else {
+        dirtyBegin = std::min(dirtyBegin, begin);
+        dirtyEnd = std::max(dirtyEnd, end);
+    }
+}
+
+/**
+ * @brief Hands the dirty instance range to the renderer and clears it.
+ * @return false if no instance changed since the last call.
+ */
+bool CubeScene::takeDirtyInstances(int *begin, int *end)
+{
+    if (dirtyEnd <= dirtyBegin)
+        return false;
+    *begin = dirtyBegin;
+    *end = std::min(dirtyEnd, int(cubeTransforms.size()));
+    dirtyBegin = dirtyEnd = 0;
+    return *begin < *end;
+}
@@ -0,0 +1,88 @@
+#ifndef CUBESCENE_H
+#define CUBESCENE_H
+
+#include <QList>
+#include <QMatrix4x4>
+#include <QQuaternion>
+#include <QString>
+#include <QVector3D>
+#include "cubeinstance.h"
+#include "cubepicker.h"
+#include "lightcluster.h"
+
+/**
+ * @brief Everything that is rendered, independent of any window or GL context: the cubes,
+ * camera, gloss and light setup. Shared by the interactive widget and the render server.
+ */
+class CubeScene
+{
+public:
+    CubeScene();
+
+    void resetDefault();
+    bool load(const QString &path, QString *errorMessage = nullptr);
+    bool save(const QString &path, QString *errorMessage = nullptr) const;
+
+    void setViewPosition(const QVector3D &eye, const QVector3D &center);
+    void zoom(int steps);
+    void toggleGloss() { gloss = !gloss; }
+    void rotateInstance(int index, const QQuaternion &rotation, const QVector3D &pivot);
+    void rotateAboutLine(int index, const QVector3D &b, const QVector3D &d, float angle);
+    void setLights(const QList<Light> &lights);
+    void toggleScatteredLights();
+    void setSelectedIndex(int index) { selected = index; }
+    void setHoveredIndex(int index) { hovered = index; }
+    void setTextureFrame(int frame) { textureFrameIndex = frame; }
+
+    void setAnimation(int index, const CubeAnimation &animation);
+    void clearAnimations();
+    void advanceAnimation(qint64 ticks = 1);
+    void bakeAnimation();
+    CubeTransform transformAt(int index) const;
+
+    int pick(const QVector3D &origin, const QVector3D &direction, float *hitDistance = nullptr);
+
+    void markInstancesDirty(int begin, int end);
+    bool takeDirtyInstances(int *begin, int *end);
+
+    const QList<CubeTransform> &transforms() const { return cubeTransforms; }
+    const QList<quint32> &texturePhases() const { return phases; }
+    const QList<CubeAnimation> &animations() const { return cubeAnimations; }
+    bool hasAnimations() const { return !cubeAnimations.isEmpty(); }
+    qint64 animationTime() const { return animationTicks; }
+    bool isAnimated() const { return animationTicks != 0 && !cubeAnimations.isEmpty(); }
+    int cubeCount() const { return cubeTransforms.size(); }
+    const QList<Light> &lights() const { return lightList; }
+    quint64 lightsRevision() const { return lightsVersion; }
+    const QMatrix4x4 &viewMatrix() const { return view; }
+    QVector3D cameraPosition() const { return camPos; }
+    QVector3D cameraTarget() const { return camTarget; }
+    float cameraDistance() const { return distance; }
+    bool glossEnabled() const { return gloss; }
+    QVector3D lightDirection() const { return lightDir; }
+    int textureFrame() const { return textureFrameIndex; }
+    int selectedIndex() const { return selected; }
+    int hoveredIndex() const { return hovered; }
+
+private:
+    void setPose(int index, const CubeTransform &pose);
+
+    QList<CubeTransform> cubeTransforms;
+    QList<quint32> phases;
+    QList<CubeAnimation> cubeAnimations; ///< Empty, or one per cube.
+    qint64 animationTicks;               ///< Ticks since the transforms were last baked.
+    QList<Light> lightList;
+    quint64 lightsVersion;
+    CubePicker picker;
+    int dirtyBegin, dirtyEnd;
+    QMatrix4x4 view;
+    QVector3D camPos, camTarget;
+    float distance;
+    bool gloss;
+    QVector3D lightDir;
+    int textureFrameIndex;
+    int selected;
+    int hovered;
+};
+
+#endif // CUBESCENE_H
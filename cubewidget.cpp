@@ -2,34 +2,38 @@
  * @file cubewidget.cpp
  * @brief Implementation of the CubeWidget class.
  *
- * This file implements the CubeWidget class which renders a 3D cube with animated
+ * This file implements the CubeWidget class which renders instanced 3D cubes with animated
  * textures, lighting, and a configurable gloss effect. It also provides features
- * for manual rotation, zooming, and toggling automatic animation.
+ * for manual rotation, zooming, toggling automatic animation and loading/saving scenes.
  */
 
  #include "cubewidget.h"
- #include <QOpenGLShader>
+ #include "tracerecorder.h"
+ #include <QOpenGLFunctions>
  #include <QPainter>
- #include <QImage>
- #include <QDebug>
  #include <QMouseEvent>
  #include <QWheelEvent>
+ #include <QElapsedTimer>
  
  /**
   * @brief Constructs a CubeWidget object.
   * @param parent Pointer to the parent widget.
   *
-  * The constructor initializes the CubeWidget by resetting the view to its default state,
-  * creating timers for animation and texture updates, and connecting their signals.
+  * The constructor initializes the CubeWidget with the default scene (see CubeScene),
+  * creating timers for animation and texture updates, and connecting their signals. Mouse
+  * tracking is enabled so that the cube under the cursor can be highlighted while hovering.
   */
  CubeWidget::CubeWidget(QWidget *parent)
      : QOpenGLWidget(parent),
        animationEnabled(false),
-       currentTextureIndex(0),
-       cameraDistance(3.0f),
-       glossEnabled(true)
+       defaultSpinCube(-1),
+       lastPickNs(0),
+       traceRecorder(nullptr),
+       externalClock(false),
+       finishFrames(false),
+       frameRequested(false)
  {
-     resetDefault();
+     setMouseTracking(true);
      animationTimer = new QTimer(this);
      connect(animationTimer, &QTimer::timeout, this, &CubeWidget::onAnimationTimer);
  
@@ -41,46 +45,43 @@
  /**
   * @brief Destroys the CubeWidget object.
   *
-  * The destructor releases the OpenGL resources by destroying the VBO and VAO, deleting
-  * all texture objects, and finalizing the OpenGL context.
+  * The destructor releases the renderer's and the overlay's OpenGL resources while the
+  * widget's context is still current.
   */
  CubeWidget::~CubeWidget()
  {
      makeCurrent();
-     vbo.destroy();
-     vao.destroy();
-     qDeleteAll(textures);
+     overlay.destroy();
+     renderer.destroy();
      doneCurrent();
  }
  
  /**
   * @brief Toggles the gloss effect on or off.
   *
-  * This slot inverts the state of the glossEnabled flag and updates the widget.
+  * This slot inverts the scene's gloss flag and updates the widget.
   */
  void CubeWidget::toggleGloss()
  {
-     glossEnabled = !glossEnabled;
+     if (traceRecorder)
+         traceRecorder->record(TraceFormat::ToggleGloss);
+     scene.toggleGloss();
      update();
  }
  
  /**
-  * @brief Applies a custom rotation to the cube.
+  * @brief Applies a custom rotation to the selected cube.
   * @param b The pivot point.
   * @param d The direction vector defining the rotation axis.
   * @param angle The angle (in degrees) by which to rotate.
   *
-  * The rotation is applied as: modelMatrix = T(b) * R(angle, normalized(d)) * T(-b) * modelMatrix.
+  * The rotation is applied as: M = T(b) * R(angle, normalized(d)) * T(-b) * M_current.
   */
  void CubeWidget::setCustomRotation(const QVector3D &b, const QVector3D &d, float angle)
  {
-     QMatrix4x4 transToOrigin; 
-     transToOrigin.translate(-b);
-     QMatrix4x4 rot; 
-     rot.rotate(angle, d.normalized());
-     QMatrix4x4 transBack; 
-     transBack.translate(b);
-     modelMatrix = transBack * rot * modelMatrix;
+     if (traceRecorder)
+         traceRecorder->record(TraceFormat::LineRotation, {b.x(), b.y(), b.z(), d.x(), d.y(), d.z(), angle});
+     scene.rotateAboutLine(scene.selectedIndex(), b, d, angle);
      update();
  }
  
@@ -94,202 +95,230 @@
   */
  void CubeWidget::setViewPosition(const QVector3D &eye, const QVector3D &center)
  {
-     viewMatrix.setToIdentity();
-     viewMatrix.lookAt(eye, center, QVector3D(0, 1, 0));
-     camPos = eye;
-     camTarget = center;
-     cameraDistance = eye.z();
+     if (traceRecorder)
+         traceRecorder->record(TraceFormat::ViewPosition, {eye.x(), eye.y(), eye.z(), center.x(), center.y(), center.z()});
+     scene.setViewPosition(eye, center);
      update();
  }
  
  /**
-  * @brief Resets the cube and camera to the default view.
+  * @brief Resets the scene and camera to the default view.
   *
-  * Sets the camera at (0,0,3) looking at the origin, and resets the model matrix
-  * to the identity matrix.
+  * Sets the camera at (0,0,3) looking at the origin, and replaces the scene with a single
+  * cube at the origin with an identity transform.
   */
  void CubeWidget::resetDefault()
  {
-     cameraDistance = 3.0f;
-     viewMatrix.setToIdentity();
-     viewMatrix.lookAt(QVector3D(0, 0, cameraDistance), QVector3D(0, 0, 0), QVector3D(0, 1, 0));
-     camPos = QVector3D(0, 0, cameraDistance);
-     camTarget = QVector3D(0, 0, 0);
-     modelMatrix.setToIdentity();
+     if (traceRecorder)
+         traceRecorder->record(TraceFormat::ResetDefault);
+     scene.resetDefault();
+     defaultSpinCube = -1;
+     ensureDefaultSpin();
      update();
  }
  
  /**
   * @brief Toggles the automatic rotation animation.
   *
-  * If animation is enabled, starts the animation timer (approx. 60 FPS);
-  * otherwise, stops the timer.
+  * If animation is enabled, starts the animation timer (approx. 60 FPS); each tick only
+  * advances the scene's animation clock, and the GPU computes the animated transforms. If the
+  * scene has no animations, the selected cube spins about its local Y-axis by 1 degree per
+  * tick. Disabling stops the timer and keeps the cubes where they are. With an external clock
+  * (trace replay) the timer is not started and ticks are delivered by the replayer instead.
   */
  void CubeWidget::toggleAnimation()
  {
-     animationEnabled = !animationEnabled;
-     if (animationEnabled)
+     if (traceRecorder)
+         traceRecorder->record(TraceFormat::ToggleAnimation);
+     if (animationEnabled) {
+         stopAnimation();
+         return;
+     }
+     animationEnabled = true;
+     ensureDefaultSpin();
+     if (!externalClock)
          animationTimer->start(16);
-     else
+ }
+ 
+ /**
+  * @brief Animates the selected cube about a line at a constant speed.
+  * @param b A point on the line.
+  * @param d The direction of the line.
+  * @param degreesPerTick Rotation speed in degrees per animation tick (approx. 60 per second).
+  *
+  * The animation is stored with the cube, so several cubes can orbit different lines at the
+  * same time; the animation is started if it is not running.
+  */
+ void CubeWidget::setLineAnimation(const QVector3D &b, const QVector3D &d, float degreesPerTick)
+ {
+     if (traceRecorder)
+         traceRecorder->record(TraceFormat::LineAnimation, {b.x(), b.y(), b.z(), d.x(), d.y(), d.z(), degreesPerTick});
+     if (defaultSpinCube >= 0) {
+         // The implicit spin may belong to a cube that is no longer selected.
+         scene.setAnimation(defaultSpinCube, CubeAnimation::none());
+         defaultSpinCube = -1;
+     }
+     scene.setAnimation(scene.selectedIndex(), CubeAnimation::aboutLine(b, d, degreesPerTick));
+     if (!animationEnabled) {
+         animationEnabled = true;
+         if (!externalClock)
+             animationTimer->start(16);
+     }
+     update();
+ }
+ 
+ /**
+  * @brief Stops the animation timer, leaving the cubes at their current poses.
+  *
+  * The implicit spin added by toggleAnimation() is removed; animations set explicitly are
+  * kept and resume when the animation is enabled again.
+  */
+ void CubeWidget::stopAnimation()
+ {
+     animationTimer->stop();
+     animationEnabled = false;
+     if (defaultSpinCube >= 0) {
+         scene.clearAnimations();
+         defaultSpinCube = -1;
+     }
+     update();
+ }
+ 
+ /**
+  * @brief While the animation is enabled, spins the selected cube if the scene has no
+  * animations of its own (the original single-cube animation).
+  */
+ void CubeWidget::ensureDefaultSpin()
+ {
+     if (!animationEnabled || scene.hasAnimations())
+         return;
+     defaultSpinCube = scene.selectedIndex();
+     scene.setAnimation(defaultSpinCube, CubeAnimation::spin(QVector3D(0, 1, 0), 1.0f));
+ }
+ 
+ /**
+  * @brief Toggles a field of scattered point and spot lights around the cube.
+  *
+  * See CubeScene::toggleScatteredLights() for the layout of the lights. Calling it again
+  * removes them.
+  */
+ void CubeWidget::toggleLights()
+ {
+     if (traceRecorder)
+         traceRecorder->record(TraceFormat::ToggleLights);
+     scene.toggleScatteredLights();
+     update();
+ }
+ 
+ /**
+  * @brief Replaces the clustered point and spot lights.
+  * @param lights The new lights (at most ClusteredLights::MaxLights are used).
+  */
+ void CubeWidget::setLights(const QList<Light> &lights)
+ {
+     scene.setLights(lights);
+     update();
+ }
+ 
+ /**
+  * @brief Records all input, menu actions, timer ticks and frames into a trace.
+  * @param recorder The recorder, or nullptr to stop recording.
+  *
+  * The widget size is recorded by resizeGL(), so the recorder should be attached before the
+  * widget is first shown; loading scenes is refused while it is attached (see loadScene()).
+  */
+ void CubeWidget::setTraceRecorder(TraceRecorder *recorder)
+ {
+     traceRecorder = recorder;
+ }
+ 
+ /**
+  * @brief Switches between the widget's own timers and an external clock.
+  * @param enabled When true the animation and texture timers are stopped and ticks must be
+  * delivered by the caller (used for deterministic trace replay). Paints requested by update(),
+  * resizes or the window system then leave the frame untouched; only renderFrame() renders.
+  */
+ void CubeWidget::setExternalClock(bool enabled)
+ {
+     externalClock = enabled;
+     if (externalClock) {
          animationTimer->stop();
+         textureTimer->stop();
+     } else {
+         textureTimer->start(700);
+         if (animationEnabled)
+             animationTimer->start(16);
+         update(); // paints were skipped while the clock was external
+     }
+ }
+ 
+ /**
+  * @brief Makes paintGL() wait for the GPU to finish the frame, so frame times measured around
+  * it include GPU work.
+  */
+ void CubeWidget::setFinishFrames(bool enabled)
+ {
+     finishFrames = enabled;
  }
  
  /**
-  * @brief Initializes the OpenGL context and resources.
+  * @brief Renders a frame synchronously, also while an external clock is set.
+  */
+ void CubeWidget::renderFrame()
+ {
+     frameRequested = true;
+     repaint();
+     frameRequested = false;
+ }
+ 
+ /**
+  * @brief Replaces the current scene with the contents of a scene file.
+  * @param path Path of the scene file.
+  * @param errorMessage Receives the reason on failure (may be nullptr).
+  * @return true if the scene was loaded.
   *
-  * This function performs the following:
-  * - Initializes OpenGL function pointers.
-  * - Sets the clear color (background color set to #456990).
-  * - Enables depth testing and back-face culling.
-  * - Compiles and links the vertex and fragment shaders.
-  *   The vertex shader handles transformations and passes normals and texture coordinates.
-  *   The fragment shader applies Phong lighting and a configurable gloss effect.
-  * - Creates and uploads cube vertex data (positions, normals, texture coordinates) to the GPU.
-  * - Loads the cube texture from the Qt resource system and splits it into three sub-images.
-  * - Configures the perspective projection matrix.
+  * Fails while a trace is being recorded: the trace cannot reproduce the file's contents, so
+  * a replay would diverge from the recording.
   */
- void CubeWidget::initializeGL()
+ bool CubeWidget::loadScene(const QString &path, QString *errorMessage)
  {
-     initializeOpenGLFunctions();
-     glClearColor(0.27f, 0.41f, 0.56f, 1.0f);  // Background color: #456990
-     glEnable(GL_DEPTH_TEST);
-     glEnable(GL_CULL_FACE);
-     glCullFace(GL_BACK);
- 
-     const char *vertexSrc = R"(
-         #version 330 core
-         layout(location = 0) in vec3 position;
-         layout(location = 1) in vec3 normal;
-         layout(location = 2) in vec2 texCoord;
-         uniform mat4 mvp;
-         uniform mat4 model;
-         out vec3 fragPos;
-         out vec3 fragNormal;
-         out vec2 vTexCoord;
-         void main(){
-             vec4 worldPos = model * vec4(position, 1.0);
-             fragPos = worldPos.xyz;
-             fragNormal = mat3(transpose(inverse(model))) * normal;
-             vTexCoord = texCoord;
-             gl_Position = mvp * worldPos;
-         }
-     )";
- 
-     const char *fragmentSrc = R"(
-         #version 330 core
-         in vec3 fragPos;
-         in vec3 fragNormal;
-         in vec2 vTexCoord;
-         uniform sampler2D textureSampler;
-         uniform vec3 lightDir;
-         uniform vec3 viewPos;
-         uniform bool uGlossOn;
-         out vec4 fragColor;
-         void main(){
-             vec4 baseColor = texture(textureSampler, vTexCoord);
-             vec3 norm = normalize(fragNormal);
-             vec3 light = normalize(-lightDir);
-             vec3 ambient = 0.2 * baseColor.rgb;
-             float diff = max(dot(norm, light), 0.0);
-             vec3 diffuse = diff * baseColor.rgb;
-             vec3 viewDir = normalize(viewPos - fragPos);
-             vec3 reflectDir = reflect(-light, norm);
-             float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32.0);
-             vec3 specular = vec3(0.0);
-             if(uGlossOn) {
-                 float sum = baseColor.r + baseColor.g + baseColor.b;
-                 float glossFactor = smoothstep(1.1216, 1.8588, sum);
-                 specular = vec3(1.0) * spec * glossFactor * 0.5;
-             }
-             vec3 result = ambient + diffuse + specular;
-             fragColor = vec4(result, 1.0);
-         }
-     )";
- 
-     shaderProgram.addShaderFromSourceCode(QOpenGLShader::Vertex, vertexSrc);
-     shaderProgram.addShaderFromSourceCode(QOpenGLShader::Fragment, fragmentSrc);
-     shaderProgram.link();
- 
-     // Cube vertex data: each vertex has 8 floats (3 position, 3 normal, 2 texCoords)
-     GLfloat vertices[] = {
-         // Front face (normal: 0,0,1)
-         -0.5f, -0.5f,  0.5f,    0, 0, 1,    0.0f, 0.0f,
-          0.5f, -0.5f,  0.5f,    0, 0, 1,    1.0f, 0.0f,
-          0.5f,  0.5f,  0.5f,    0, 0, 1,    1.0f, 1.0f,
-          0.5f,  0.5f,  0.5f,    0, 0, 1,    1.0f, 1.0f,
-         -0.5f,  0.5f,  0.5f,    0, 0, 1,    0.0f, 1.0f,
-         -0.5f, -0.5f,  0.5f,    0, 0, 1,    0.0f, 0.0f,
-         // Back face (normal: 0,0,-1)
-         -0.5f, -0.5f, -0.5f,    0, 0, -1,   1.0f, 0.0f,
-         -0.5f,  0.5f, -0.5f,    0, 0, -1,   1.0f, 1.0f,
-          0.5f,  0.5f, -0.5f,    0, 0, -1,   0.0f, 1.0f,
-          0.5f,  0.5f, -0.5f,    0, 0, -1,   0.0f, 1.0f,
-          0.5f, -0.5f, -0.5f,    0, 0, -1,   0.0f, 0.0f,
-         -0.5f, -0.5f, -0.5f,    0, 0, -1,   1.0f, 0.0f,
-         // Left face (normal: -1,0,0)
-         -0.5f,  0.5f,  0.5f,   -1, 0, 0,    1.0f, 0.0f,
-         -0.5f,  0.5f, -0.5f,   -1, 0, 0,    1.0f, 1.0f,
-         -0.5f, -0.5f, -0.5f,   -1, 0, 0,    0.0f, 1.0f,
-         -0.5f, -0.5f, -0.5f,   -1, 0, 0,    0.0f, 1.0f,
-         -0.5f, -0.5f,  0.5f,   -1, 0, 0,    0.0f, 0.0f,
-         -0.5f,  0.5f,  0.5f,   -1, 0, 0,    1.0f, 0.0f,
-         // Right face (normal: 1,0,0)
-          0.5f,  0.5f,  0.5f,    1, 0, 0,    1.0f, 0.0f,
-          0.5f, -0.5f, -0.5f,    1, 0, 0,    0.0f, 1.0f,
-          0.5f,  0.5f, -0.5f,    1, 0, 0,    1.0f, 1.0f,
-          0.5f, -0.5f, -0.5f,    1, 0, 0,    0.0f, 1.0f,
-          0.5f,  0.5f,  0.5f,    1, 0, 0,    1.0f, 0.0f,
-          0.5f, -0.5f,  0.5f,    1, 0, 0,    0.0f, 0.0f,
-         // Top face (normal: 0,1,0)
-         -0.5f,  0.5f, -0.5f,    0,1,0,    0.0f, 1.0f,
-         -0.5f,  0.5f,  0.5f,    0,1,0,    0.0f, 0.0f,
-          0.5f,  0.5f,  0.5f,    0,1,0,    1.0f, 0.0f,
-          0.5f,  0.5f,  0.5f,    0,1,0,    1.0f, 0.0f,
-          0.5f,  0.5f, -0.5f,    0,1,0,    1.0f, 1.0f,
-         -0.5f,  0.5f, -0.5f,    0,1,0,    0.0f, 1.0f,
-         // Bottom face (normal: 0,-1,0)
-         -0.5f, -0.5f, -0.5f,    0,-1,0,   1.0f, 1.0f,
-          0.5f, -0.5f, -0.5f,    0,-1,0,   0.0f, 1.0f,
-          0.5f, -0.5f,  0.5f,    0,-1,0,   0.0f, 0.0f,
-          0.5f, -0.5f,  0.5f,    0,-1,0,   0.0f, 0.0f,
-         -0.5f, -0.5f,  0.5f,    0,-1,0,   1.0f, 0.0f,
-         -0.5f, -0.5f, -0.5f,    0,-1,0,   1.0f, 1.0f
-     };
- 
-     vao.create();
-     vao.bind();
-     vbo.create();
-     vbo.bind();
-     vbo.allocate(vertices, sizeof(vertices));
-     shaderProgram.bind();
-     // Set vertex attribute 0: position (3 floats)
-     shaderProgram.enableAttributeArray(0);
-     shaderProgram.setAttributeBuffer(0, GL_FLOAT, 0, 3, 8 * sizeof(GLfloat));
-     // Set vertex attribute 1: normal (3 floats)
-     shaderProgram.enableAttributeArray(1);
-     shaderProgram.setAttributeBuffer(1, GL_FLOAT, 3 * sizeof(GLfloat), 3, 8 * sizeof(GLfloat));
-     // Set vertex attribute 2: texture coordinates (2 floats)
-     shaderProgram.enableAttributeArray(2);
-     shaderProgram.setAttributeBuffer(2, GL_FLOAT, 6 * sizeof(GLfloat), 2, 8 * sizeof(GLfloat));
-     vao.release();
- 
-     // Load texture from resources using a relative path in the Qt resource system.
-     QImage fullImage(":/textures/textures/texture.png");
-     if (fullImage.isNull())
-         qDebug() << "Error loading texture";
-     else {
-         for (int i = 0; i < 3; ++i) {
-             QImage sub = fullImage.copy(0, i * 16, 16, 16);
-             QOpenGLTexture *tex = new QOpenGLTexture(sub.mirrored());
-             tex->setMinificationFilter(QOpenGLTexture::Nearest);
-             tex->setMagnificationFilter(QOpenGLTexture::Nearest);
-             tex->setWrapMode(QOpenGLTexture::ClampToEdge);
-             textures.append(tex);
-         }
+     if (traceRecorder) {
+         if (errorMessage)
+             *errorMessage = "Scenes cannot be loaded while a trace is being recorded; use --scene.";
+         return false;
      }
+     if (!scene.load(path, errorMessage))
+         return false;
+     defaultSpinCube = -1;
+     ensureDefaultSpin();
+     update();
+     return true;
+ }
  
-     projectionMatrix.setToIdentity();
-     projectionMatrix.perspective(45.0f, float(width())/height(), 0.1f, 100.0f);
+ /**
+  * @brief Writes the current scene (cubes, texture phases, camera and lights) to a file.
+  * @param path Path of the scene file.
+  * @param errorMessage Receives the reason on failure (may be nullptr).
+  * @return true if the scene was saved.
+  */
+ bool CubeWidget::saveScene(const QString &path, QString *errorMessage)
+ {
+     return scene.save(path, errorMessage);
+ }
+ 
+ /**
+  * @brief Initializes the OpenGL resources.
+  *
+  * The renderer compiles the shaders and creates the vertex, instance, texture and light
+  * objects in the widget's context; the projection is then set up for the widget size. The
+  * text overlay builds its glyph atlas for the widget's font.
+  */
+ void CubeWidget::initializeGL()
+ {
+     renderer.initialize();
+     renderer.resize(width(), height());
+     overlay.initialize(renderer.queue());
+     overlay.setFont(font(), devicePixelRatioF());
  }
  
  /**
@@ -299,119 +328,212 @@
   */
  void CubeWidget::resizeGL(int w, int h)
  {
-     glViewport(0, 0, w, h);
-     projectionMatrix.setToIdentity();
-     projectionMatrix.perspective(45.0f, float(w)/h, 0.1f, 100.0f);
+     if (traceRecorder)
+         traceRecorder->record(TraceFormat::Resize, {float(w), float(h)});
+     renderer.resize(w, h);
+     // Moving to a screen with another pixel ratio also resizes the framebuffer.
+     overlay.setFont(font(), devicePixelRatioF());
  }
  
  /**
   * @brief Renders the cube and overlays status text.
   *
-  * This method clears the screen, computes the MVP matrix, binds the shader program and
-  * sets the necessary uniforms (including lighting and gloss toggle). It then draws the cube
-  * and uses QPainter to overlay text showing the cube's rotation and camera information.
+  * The renderer draws the scene (see CubeRenderer::render()) and, in the same render queue
+  * flush, the status text added by submitOverlay(). The text is formatted into the renderer's
+  * frame arena, so once warmed up a frame makes no heap allocations; the allocations of each
+  * call are kept in lastFrameAllocations. With an external clock only the frames requested
+  * through renderFrame() are drawn.
   */
  void CubeWidget::paintGL()
  {
-     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-     QMatrix4x4 mvp = projectionMatrix * viewMatrix * modelMatrix;
-     shaderProgram.bind();
-     shaderProgram.setUniformValue("mvp", mvp);
-     shaderProgram.setUniformValue("model", modelMatrix);
-     shaderProgram.setUniformValue("viewPos", camPos);
-     shaderProgram.setUniformValue("lightDir", QVector3D(0.0f, 0.0f, -1.0f));
-     shaderProgram.setUniformValue("uGlossOn", glossEnabled);
-     if (!textures.isEmpty()) {
-         textures[currentTextureIndex]->bind(0);
-         shaderProgram.setUniformValue("textureSampler", 0);
-     }
-     vao.bind();
-     glDrawArrays(GL_TRIANGLES, 0, 36);
-     vao.release();
- 
-     QPainter painter(this);
-     painter.setPen(Qt::white);
-     QQuaternion quat = QQuaternion::fromRotationMatrix(modelMatrix.toGenericMatrix<3,3>());
-     QVector3D euler = quat.toEulerAngles();
-     painter.drawText(10, 20, QString("Cube Rotation (pitch,yaw,roll): (%1, %2, %3)")
-                                  .arg(euler.x(), 0, 'f', 2)
-                                  .arg(euler.y(), 0, 'f', 2)
-                                  .arg(euler.z(), 0, 'f', 2));
-     painter.drawText(10, 40, QString("Camera Pos: (%1, %2, %3)")
-                                  .arg(camPos.x(), 0, 'f', 2)
-                                  .arg(camPos.y(), 0, 'f', 2)
-                                  .arg(camPos.z(), 0, 'f', 2));
-     painter.drawText(10, 60, QString("Camera Target: (%1, %2, %3)")
-                                  .arg(camTarget.x(), 0, 'f', 2)
-                                  .arg(camTarget.y(), 0, 'f', 2)
-                                  .arg(camTarget.z(), 0, 'f', 2));
+     if (externalClock && !frameRequested)
+         return;
+     const AllocStats::Counters before = AllocStats::current();
+     if (traceRecorder)
+         traceRecorder->record(TraceFormat::Frame);
+     renderer.render(scene, [this](RenderQueue &queue, FrameArena &arena) {
+         submitOverlay(queue, arena);
+     });
+     if (finishFrames)
+         context()->functions()->glFinish();
+     lastFrameAllocations = AllocStats::current() - before;
+ }
+ 
+ /**
+  * @brief Adds the status text to the frame as overlay packets.
+  *
+  * Shows the cube's rotation, camera information and, as of the previous frame, the render
+  * queue's counters and (in builds with allocation tracking) the heap use.
+  */
+ void CubeWidget::submitOverlay(RenderQueue &queue, FrameArena &arena)
+ {
+     using Fixed = OverlayLine::Fixed;
+     const QVector3D camPos = scene.cameraPosition();
+     const QVector3D camTarget = scene.cameraTarget();
+     const QVector3D euler = scene.transformAt(scene.selectedIndex()).rotation().toEulerAngles();
+     overlay.begin(arena, width(), height());
+     overlay.addText(10, 20, OverlayLine(arena) << "Cube Rotation (pitch,yaw,roll): ("
+                                                << Fixed{euler.x(), 2} << ", " << Fixed{euler.y(), 2}
+                                                << ", " << Fixed{euler.z(), 2} << ")");
+     overlay.addText(10, 40, OverlayLine(arena) << "Camera Pos: (" << Fixed{camPos.x(), 2} << ", "
+                                                << Fixed{camPos.y(), 2} << ", " << Fixed{camPos.z(), 2} << ")");
+     overlay.addText(10, 60, OverlayLine(arena) << "Camera Target: (" << Fixed{camTarget.x(), 2} << ", "
+                                                << Fixed{camTarget.y(), 2} << ", " << Fixed{camTarget.z(), 2}
+                                                << ")");
+     overlay.addText(10, 80, OverlayLine(arena) << "Cubes: " << scene.cubeCount()
+                                                << "  Selected: " << scene.selectedIndex()
+                                                << "  Pick: " << Fixed{lastPickNs / 1000.0, 1} << " us");
+     const ClusteredLights &lights = renderer.lights();
+     if (lights.lightCount() > 0)
+         overlay.addText(10, 100, OverlayLine(arena) << "Lights: " << lights.lightCount() << " ("
+                                                     << lights.indexCount() << " cluster entries)");
+     if (AllocStats::isEnabled())
+         overlay.addText(10, height() - 30, OverlayLine(arena)
+                                                << "Heap: " << qint64(lastFrameAllocations.allocations)
+                                                << " allocs, " << qint64(lastFrameAllocations.bytes)
+                                                << " bytes last frame  Arena: " << qint64(arena.peak() / 1024)
+                                                << " KiB peak");
+     const RenderQueue::Stats &stats = renderer.stats();
+     overlay.addText(10, height() - 10, OverlayLine(arena)
+                                            << "Draws: " << stats.draws
+                                            << "  Binds: " << stats.programBinds + stats.textureBinds + stats.vaoBinds
+                                            << "  State changes: " << stats.stateChanges
+                                            << "  Skipped: " << stats.redundantSkipped);
+     overlay.submit(queue);
  }
  
  /**
   * @brief Handles mouse wheel events to zoom in and out.
   * @param event Pointer to the QWheelEvent.
   *
+  * Forwards the vertical wheel delta to handleWheel().
+  */
+ void CubeWidget::wheelEvent(QWheelEvent *event)
+ {
+     handleWheel(event->angleDelta().y());
+ }
+ 
+ /**
+  * @brief Zooms the camera in or out.
+  * @param angleDeltaY Vertical wheel delta in eighths of a degree.
+  *
   * The camera distance is adjusted based on the wheel delta. The view matrix is updated
   * accordingly.
   */
- void CubeWidget::wheelEvent(QWheelEvent *event)
+ void CubeWidget::handleWheel(int angleDeltaY)
  {
-     int numDegrees = event->angleDelta().y() / 8;
+     if (traceRecorder)
+         traceRecorder->record(TraceFormat::Wheel, {float(angleDeltaY)});
+     int numDegrees = angleDeltaY / 8;
      int numSteps = numDegrees / 15;
-     cameraDistance -= numSteps * 0.5f;
-     if (cameraDistance < 1.0f)
-         cameraDistance = 1.0f;
-     if (cameraDistance > 20.0f)
-         cameraDistance = 20.0f;
-     viewMatrix.setToIdentity();
-     viewMatrix.lookAt(QVector3D(0,0,cameraDistance), QVector3D(0,0,0), QVector3D(0,1,0));
-     camPos = QVector3D(0,0,cameraDistance);
+     scene.zoom(numSteps);
      update();
  }
  
  /**
-  * @brief Processes mouse press events for manual rotation.
-  * @param event Pointer to the QMouseEvent.
+  * @brief Casts a ray from the camera through a widget position and picks the nearest cube.
+  * @param pos Position in widget coordinates.
+  * @return Index of the cube under the position, or -1.
   *
-  * When the mouse is pressed, the current position is stored.
-  * If the automatic animation is running, it is stopped.
+  * The ray is obtained by unprojecting the position at the near and far planes. The time
+  * taken is kept in lastPickNs for the overlay.
+  */
+ int CubeWidget::pickAt(const QPoint &pos)
+ {
+     QElapsedTimer timer;
+     timer.start();
+     const float x = 2.0f * pos.x() / width() - 1.0f;
+     const float y = 1.0f - 2.0f * pos.y() / height();
+     const QMatrix4x4 inverse = (renderer.projectionMatrix() * scene.viewMatrix()).inverted();
+     const QVector3D nearPoint = inverse.map(QVector3D(x, y, -1.0f));
+     const QVector3D farPoint = inverse.map(QVector3D(x, y, 1.0f));
+     const int hit = scene.pick(nearPoint, (farPoint - nearPoint).normalized());
+     lastPickNs = timer.nsecsElapsed();
+     return hit;
+ }
+ 
+ /**
+  * @brief Processes mouse press events for selection and manual rotation.
+  * @param event Pointer to the QMouseEvent.
   */
  void CubeWidget::mousePressEvent(QMouseEvent *event)
  {
-     lastMousePos = event->pos();
-     if (animationEnabled) {
-         animationTimer->stop();
-         animationEnabled = false;
+     handleMousePress(event->pos());
+ }
+ 
+ /**
+  * @brief Handles a mouse press at a widget position.
+  * @param pos Position in widget coordinates.
+  *
+  * When the mouse is pressed, the current position is stored and the cube under the cursor
+  * (if any) becomes the selected cube. If the automatic animation is running, it is stopped.
+  */
+ void CubeWidget::handleMousePress(const QPoint &pos)
+ {
+     if (traceRecorder)
+         traceRecorder->record(TraceFormat::MousePress, {float(pos.x()), float(pos.y())});
+     lastMousePos = pos;
+     const int hit = pickAt(pos);
+     if (hit >= 0 && hit != scene.selectedIndex()) {
+         scene.setSelectedIndex(hit);
+         update();
      }
+     if (animationEnabled)
+         stopAnimation();
  }
  
  /**
-  * @brief Processes mouse movement events for manual rotation.
+  * @brief Processes mouse movement events for hover highlighting and manual rotation.
   * @param event Pointer to the QMouseEvent.
-  *
-  * Calculates the rotation delta based on the mouse movement and updates the model matrix.
   */
  void CubeWidget::mouseMoveEvent(QMouseEvent *event)
  {
-     QPoint delta = event->pos() - lastMousePos;
-     lastMousePos = event->pos();
+     handleMouseMove(event->pos(), event->buttons());
+ }
+ 
+ /**
+  * @brief Handles a mouse move to a widget position.
+  * @param pos Position in widget coordinates.
+  * @param buttons Mouse buttons held during the move.
+  *
+  * Without a pressed button, the cube under the cursor is picked and highlighted; animated
+  * cubes are picked at their current poses. While dragging, calculates the rotation delta
+  * based on the mouse movement and rotates the selected cube about its own center.
+  */
+ void CubeWidget::handleMouseMove(const QPoint &pos, Qt::MouseButtons buttons)
+ {
+     if (traceRecorder)
+         traceRecorder->record(TraceFormat::MouseMove, {float(pos.x()), float(pos.y())}, quint16(buttons.toInt()));
+     if (!buttons) {
+         const int hit = pickAt(pos);
+         if (hit != scene.hoveredIndex()) {
+             scene.setHoveredIndex(hit);
+             update();
+         }
+         return;
+     }
+     QPoint delta = pos - lastMousePos;
+     lastMousePos = pos;
      float angleX = delta.y();
      float angleY = delta.x();
-     QMatrix4x4 manualRot;
-     manualRot.rotate(angleX, QVector3D(1,0,0));
-     manualRot.rotate(angleY, QVector3D(0,1,0));
-     modelMatrix = manualRot * modelMatrix;
+     QQuaternion manualRot = QQuaternion::fromAxisAndAngle(QVector3D(1,0,0), angleX)
+                           * QQuaternion::fromAxisAndAngle(QVector3D(0,1,0), angleY);
+     const int selected = scene.selectedIndex();
+     scene.rotateInstance(selected, manualRot, scene.transformAt(selected).translation());
      update();
  }
  
  /**
   * @brief Called when the animation timer times out.
   *
-  * Rotates the cube around the Y-axis by 1 degree and updates the display.
+  * Advances the animation clock by one tick and updates the display; the animated cubes are
+  * moved on the GPU, so a tick costs the same for one cube or a million.
   */
  void CubeWidget::onAnimationTimer()
  {
-     modelMatrix.rotate(1.0f, QVector3D(0,1,0));
+     if (traceRecorder)
+         traceRecorder->record(TraceFormat::AnimationTick);
+     scene.advanceAnimation();
      update();
  }
  
@@ -422,8 +544,10 @@
   */
  void CubeWidget::updateTexture()
  {
-     if (!textures.isEmpty()) {
-         currentTextureIndex = (currentTextureIndex + 1) % textures.size();
+     if (traceRecorder)
+         traceRecorder->record(TraceFormat::TextureTick);
+     if (renderer.textureLayers() > 0) {
+         scene.setTextureFrame((scene.textureFrame() + 1) % renderer.textureLayers());
          update();
      }
  }
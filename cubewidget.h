@@ -2,30 +2,46 @@
 #define CUBEWIDGET_H
 
 #include <QOpenGLWidget>
-#include <QOpenGLFunctions>
-#include <QOpenGLShaderProgram>
-#include <QOpenGLBuffer>
-#include <QOpenGLVertexArrayObject>
-#include <QOpenGLTexture>
 #include <QTimer>
 #include <QList>
 #include <QPoint>
 #include <QVector3D>
-#include <QMatrix4x4>
+#include "allocstats.h"
+#include "cuberenderer.h"
+#include "cubescene.h"
+#include "textoverlay.h"
 
-class CubeWidget : public QOpenGLWidget, protected QOpenGLFunctions
+class TraceRecorder;
+
+class CubeWidget : public QOpenGLWidget
 {
     Q_OBJECT
 public:
     explicit CubeWidget(QWidget *parent = nullptr);
     ~CubeWidget();
 
+    bool loadScene(const QString &path, QString *errorMessage = nullptr);
+    bool saveScene(const QString &path, QString *errorMessage = nullptr);
+
+    void setTraceRecorder(TraceRecorder *recorder);
+    void setExternalClock(bool enabled);
+    void setFinishFrames(bool enabled);
+    void renderFrame();
+    const AllocStats::Counters &frameAllocations() const { return lastFrameAllocations; }
+
+    void handleMousePress(const QPoint &pos);
+    void handleMouseMove(const QPoint &pos, Qt::MouseButtons buttons);
+    void handleWheel(int angleDeltaY);
+
 public slots:
     void toggleGloss();
     void setCustomRotation(const QVector3D &b, const QVector3D &d, float angle);
     void setViewPosition(const QVector3D &eye, const QVector3D &center);
     void resetDefault();
     void toggleAnimation();
+    void setLineAnimation(const QVector3D &b, const QVector3D &d, float degreesPerTick);
+    void toggleLights();
+    void setLights(const QList<Light> &lights);
 
 protected:
     void initializeGL() override;
@@ -40,19 +56,27 @@ private slots:
     void updateTexture();
 
 private:
-    QOpenGLShaderProgram shaderProgram;
-    QOpenGLBuffer vbo { QOpenGLBuffer::VertexBuffer };
-    QOpenGLVertexArrayObject vao;
-    QMatrix4x4 projectionMatrix, viewMatrix, modelMatrix;
+    friend class TraceReplayer; // replays timer ticks through the private slots
+
+    int pickAt(const QPoint &pos);
+    void stopAnimation();
+    void ensureDefaultSpin();
+    void submitOverlay(RenderQueue &queue, FrameArena &arena);
+
+    CubeScene scene;
+    CubeRenderer renderer;
+    TextOverlay overlay;
     QTimer *animationTimer;
     QTimer *textureTimer;
     bool animationEnabled;
-    QList<QOpenGLTexture*> textures;
-    int currentTextureIndex;
+    int defaultSpinCube; ///< Cube spun by ensureDefaultSpin(), or -1 if there is none.
+    qint64 lastPickNs;
+    TraceRecorder *traceRecorder;
+    bool externalClock;
+    bool finishFrames;
+    bool frameRequested; ///< Set by renderFrame(); with an external clock only those frames render.
     QPoint lastMousePos;
-    QVector3D camPos, camTarget;
-    float cameraDistance;
-    bool glossEnabled;
+    AllocStats::Counters lastFrameAllocations; ///< Heap use of the last paintGL() call.
 };
 
 #endif // CUBEWIDGET_H
@@ -0,0 +1,72 @@
+/**
+ * @file framearena.cpp
+ * @brief Implementation of the per-frame linear allocator.
+ */
+
+#include "framearena.h"
+#include <algorithm>
+
+/**
+ * @brief Constructs an arena with one block of the given size.
+ */
+FrameArena::FrameArena(qsizetype initialCapacity)
+    : block(new char[initialCapacity]),
+      blockSize(initialCapacity),
+      offset(0),
+      overflowBytes(0),
+      peakBytes(0)
+{
+}
+
+/**
+ * @brief Frees the block and any overflow memory. Pointers handed out become invalid.
+ */
+FrameArena::~FrameArena()
+{
+    reset();
+    delete[] block;
+}
+
+/**
+ * @brief Releases everything allocated since the last reset.
+ *
+ * If the frame overflowed the block, the block is replaced by one of at least the frame's
+ * total size (rounded up to a power of two), so the same workload fits next time.
+ */
+void FrameArena::reset()
+{
+    if (!overflow.isEmpty()) {
+        for (char *memory : std::as_const(overflow))
+            delete[] memory;
+        overflow.clear();
+        qsizetype newSize = std::max<qsizetype>(blockSize, 1);
+        while (newSize < peakBytes)
+            newSize *= 2;
+        delete[] block;
+        block = new char[newSize];
+        blockSize = newSize;
+    }
+    offset = 0;
+    overflowBytes = 0;
+}
+
+/**
+ * @brief Returns uninitialized memory valid until the next reset().
+ * @param bytes Size of the allocation.
+ * @param alignment Required alignment (a power of two, at most alignof(std::max_align_t)).
+ */
+void *FrameArena::allocate(qsizetype bytes, qsizetype alignment)
+{
+    const qsizetype start = (offset + alignment - 1) & ~(alignment - 1);
+    if (start + bytes <= blockSize) {
+        offset = start + bytes;
+        peakBytes = std::max(peakBytes, used());
+        return block + start;
+    }
+    // Out of space: serve this frame from the heap, reset() grows the block.
+    char *memory = new char[std::max<qsizetype>(bytes, 1)];
+    overflow.append(memory);
+    overflowBytes += bytes + alignment;
+    peakBytes = std::max(peakBytes, used());
+    return memory;
+}
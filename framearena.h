@@ -0,0 +1,52 @@
+#ifndef FRAMEARENA_H
+#define FRAMEARENA_H
+
+#include <QList>
+#include <QtGlobal>
+#include <cstddef>
+#include <type_traits>
+
+/**
+ * @brief Linear allocator for data that lives for one frame (sort scratch, light bounds,
+ * overlay text and vertices).
+ *
+ * allocate() bumps an offset in one block and reset() rewinds it, so per-frame allocations
+ * cost a few instructions and never reach the heap. A frame that needs more than the block
+ * gets its extra memory from the heap, and the next reset() replaces the block with one large
+ * enough for that frame: after a few warm-up frames the arena stops allocating.
+ *
+ * Memory is not constructed or destroyed, so only trivial types may be allocated.
+ */
+class FrameArena
+{
+public:
+    explicit FrameArena(qsizetype initialCapacity = 256 * 1024);
+    ~FrameArena();
+
+    void reset();
+    void *allocate(qsizetype bytes, qsizetype alignment = alignof(std::max_align_t));
+
+    template<typename T>
+    T *allocateArray(qsizetype count)
+    {
+        static_assert(std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T>,
+                      "FrameArena only holds trivial types");
+        return static_cast<T *>(allocate(count * qsizetype(sizeof(T)), alignof(T)));
+    }
+
+    qsizetype capacity() const { return blockSize; }
+    qsizetype used() const { return offset + overflowBytes; }
+    qsizetype peak() const { return peakBytes; } ///< Largest used() since construction.
+
+private:
+    Q_DISABLE_COPY(FrameArena)
+
+    char *block;
+    qsizetype blockSize;
+    qsizetype offset;
+    qsizetype overflowBytes;
+    qsizetype peakBytes;
+    QList<char *> overflow; ///< Heap blocks of the current frame beyond the main block.
+};
+
+#endif // FRAMEARENA_H
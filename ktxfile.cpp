@@ -0,0 +1,222 @@
+/**
+ * @file ktxfile.cpp
+ * @brief Reading and writing KTX 1.1 texture containers.
+ *
+ * A KTX file is a 64-byte header, optional key/value metadata and one block per mip level:
+ * a 32-bit byte count followed by the level's data for every array layer, padded to four
+ * bytes. The data is exactly what glTexSubImage3D / glCompressedTexSubImage3D expect, so the
+ * runtime loader hands pointers into the mapped file straight to OpenGL.
+ *
+ * Only what the cube textures need is supported: little-endian files with a single face,
+ * 2D or 2D array textures, RGBA8, BC1 or ETC2 RGB8. Images are stored bottom row first
+ * (KTXorientation "S=r,T=u"), i.e. in OpenGL's texture coordinate order.
+ */
+
+#include "ktxfile.h"
+#include <cstring>
+
+using namespace KtxFormat;
+
+namespace {
+const quint8 kIdentifier[12] = {0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+qint64 padded(qint64 bytes)
+{
+    return (bytes + 3) & ~qint64(3);
+}
+}
+
+/**
+ * @brief Fills in a header for a 2D array texture (layers > 1) or a 2D texture.
+ */
+Header KtxFormat::makeHeader(quint32 internalFormat, int width, int height, int layers, int mipLevels)
+{
+    Header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.identifier, kIdentifier, sizeof(kIdentifier));
+    header.endianness = Endianness;
+    const bool compressed = isCompressed(internalFormat);
+    header.glType = compressed ? 0 : UnsignedByte;
+    header.glTypeSize = 1;
+    header.glFormat = compressed ? 0 : Rgba;
+    header.glInternalFormat = internalFormat;
+    header.glBaseInternalFormat = internalFormat == Rgba8 ? Rgba : Rgb;
+    header.pixelWidth = quint32(width);
+    header.pixelHeight = quint32(height);
+    header.pixelDepth = 0;
+    header.numberOfArrayElements = layers > 1 ? quint32(layers) : 0;
+    header.numberOfFaces = 1;
+    header.numberOfMipmapLevels = quint32(mipLevels);
+    return header;
+}
+
+/**
+ * @brief Returns true for the block-compressed formats.
+ */
+bool KtxFormat::isCompressed(quint32 internalFormat)
+{
+    return internalFormat == CompressedRgbS3tcDxt1 || internalFormat == CompressedRgb8Etc2;
+}
+
+/**
+ * @brief Returns the size in bytes of one width x height image, or -1 for unsupported formats.
+ *
+ * Both compressed formats use 8-byte blocks of 4x4 pixels; partial blocks at the edges of
+ * small mip levels still take a whole block.
+ */
+qint64 KtxFormat::imageSize(quint32 internalFormat, int width, int height)
+{
+    switch (internalFormat) {
+    case Rgba8:
+        return qint64(width) * height * 4;
+    case CompressedRgbS3tcDxt1:
+    case CompressedRgb8Etc2:
+        return qint64((width + 3) / 4) * ((height + 3) / 4) * 8;
+    default:
+        return -1;
+    }
+}
+
+/**
+ * @brief Constructs an empty (closed) file.
+ */
+KtxFile::KtxFile()
+    : data(nullptr),
+      size(0)
+{
+    std::memset(&head, 0, sizeof(head));
+}
+
+/**
+ * @brief Unmaps the file, invalidating all pointers handed out.
+ */
+KtxFile::~KtxFile()
+{
+    close();
+}
+
+bool KtxFile::fail(const QString &message)
+{
+    error = message;
+    close();
+    return false;
+}
+
+/**
+ * @brief Opens a KTX file and validates its header and level table.
+ * @param path Path of the file (may be a Qt resource path).
+ * @return true on success; see errorString() otherwise.
+ */
+bool KtxFile::open(const QString &path)
+{
+    close();
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return fail(file.errorString());
+    size = file.size();
+    if (size < qint64(sizeof(Header)))
+        return fail("File is too small to be a KTX file");
+    data = file.map(0, size);
+    if (!data) {
+        // Compressed resources cannot be mapped.
+        buffer = file.readAll();
+        if (buffer.size() != size)
+            return fail(file.errorString());
+        data = reinterpret_cast<const uchar *>(buffer.constData());
+    }
+
+    std::memcpy(&head, data, sizeof(head));
+    if (std::memcmp(head.identifier, kIdentifier, sizeof(kIdentifier)) != 0)
+        return fail("Not a KTX file");
+    if (head.endianness != Endianness)
+        return fail("Big-endian KTX files are not supported");
+    if (head.numberOfFaces != 1 || head.pixelDepth != 0 || head.pixelWidth == 0 || head.pixelHeight == 0)
+        return fail("Only 2D and 2D array KTX textures are supported");
+    if (imageSize(head.glInternalFormat, 1, 1) < 0)
+        return fail(QString("Unsupported KTX format 0x%1").arg(head.glInternalFormat, 0, 16));
+
+    const int levelCount = std::max(1, int(head.numberOfMipmapLevels));
+    qint64 offset = qint64(sizeof(Header)) + head.bytesOfKeyValueData;
+    for (int level = 0; level < levelCount; ++level) {
+        if (level > 0 && width(level - 1) == 1 && height(level - 1) == 1)
+            return fail("KTX file has more mip levels than its size allows");
+        quint32 bytes = 0;
+        if (offset + qint64(sizeof(bytes)) > size)
+            return fail("KTX file is truncated");
+        std::memcpy(&bytes, data + offset, sizeof(bytes));
+        offset += sizeof(bytes);
+        const qint64 layerSize = imageSize(head.glInternalFormat, width(level), height(level));
+        if (qint64(bytes) != layerSize * layers() || offset + qint64(bytes) > size)
+            return fail(QString("KTX mip level %1 has an unexpected size").arg(level));
+        levels.append({offset, layerSize});
+        offset += padded(bytes);
+    }
+    return true;
+}
+
+/**
+ * @brief Unmaps and closes the file.
+ */
+void KtxFile::close()
+{
+    if (data && buffer.isEmpty())
+        file.unmap(const_cast<uchar *>(data));
+    data = nullptr;
+    buffer.clear();
+    size = 0;
+    levels.clear();
+    if (file.isOpen())
+        file.close();
+}
+
+/**
+ * @brief Returns one layer of one mip level.
+ * @param bytes Receives the size in bytes (may be nullptr).
+ */
+const uchar *KtxFile::layerData(int level, int layer, qint64 *bytes) const
+{
+    const Level &entry = levels.at(level);
+    if (bytes)
+        *bytes = entry.layerSize;
+    return data + entry.offset + layer * entry.layerSize;
+}
+
+/**
+ * @brief Writes a KTX file.
+ * @param path Path of the file.
+ * @param header Header from KtxFormat::makeHeader().
+ * @param levelData One entry per mip level, holding all layers of that level.
+ * @param errorMessage Receives the reason on failure (may be nullptr).
+ *
+ * The KTXorientation key is written so other tools show the image the right way up.
+ */
+bool KtxFile::write(const QString &path, const Header &header, const QList<QByteArray> &levelData,
+                    QString *errorMessage)
+{
+    static const char orientation[] = "KTXorientation\0S=r,T=u";
+    const quint32 keyValueSize = sizeof(orientation); // includes the value's terminator
+    QByteArray keyValues(reinterpret_cast<const char *>(&keyValueSize), sizeof(keyValueSize));
+    keyValues.append(orientation, sizeof(orientation));
+    keyValues.append(padded(keyValues.size()) - keyValues.size(), '\0');
+
+    Header out = header;
+    out.bytesOfKeyValueData = quint32(keyValues.size());
+    out.numberOfMipmapLevels = quint32(levelData.size());
+
+    QFile file(path);
+    bool ok = file.open(QIODevice::WriteOnly | QIODevice::Truncate)
+            && file.write(reinterpret_cast<const char *>(&out), sizeof(out)) == qint64(sizeof(out))
+            && file.write(keyValues) == keyValues.size();
+    for (const QByteArray &level : levelData) {
+        if (!ok)
+            break;
+        const quint32 bytes = quint32(level.size());
+        const QByteArray padding(padded(bytes) - bytes, '\0');
+        ok = file.write(reinterpret_cast<const char *>(&bytes), sizeof(bytes)) == qint64(sizeof(bytes))
+                && file.write(level) == level.size()
+                && file.write(padding) == padding.size();
+    }
+    if (!ok && errorMessage)
+        *errorMessage = file.errorString();
+    return ok;
+}
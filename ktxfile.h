@@ -0,0 +1,99 @@
+#ifndef KTXFILE_H
+#define KTXFILE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QList>
+#include <QString>
+#include <QtGlobal>
+#include <algorithm>
+
+/**
+ * @brief KTX 1.1 container layout and the GL enums used in its header. The enums are spelled
+ * out so that the offline baker does not need OpenGL headers.
+ */
+namespace KtxFormat {
+
+constexpr quint32 Endianness = 0x04030201;
+
+enum GlEnum : quint32 {
+    UnsignedByte = 0x1401,
+    Rgb = 0x1907,
+    Rgba = 0x1908,
+    Rgba8 = 0x8058,
+    CompressedRgbS3tcDxt1 = 0x83F0, ///< BC1, 4 bits per pixel.
+    CompressedRgb8Etc2 = 0x9274     ///< ETC2 RGB (ETC1-compatible blocks), 4 bits per pixel.
+};
+
+struct Header
+{
+    quint8 identifier[12];
+    quint32 endianness;
+    quint32 glType;               ///< 0 for compressed formats.
+    quint32 glTypeSize;
+    quint32 glFormat;             ///< 0 for compressed formats.
+    quint32 glInternalFormat;
+    quint32 glBaseInternalFormat;
+    quint32 pixelWidth;
+    quint32 pixelHeight;
+    quint32 pixelDepth;           ///< 0 for 2D textures.
+    quint32 numberOfArrayElements;///< Layers of an array texture, 0 otherwise.
+    quint32 numberOfFaces;
+    quint32 numberOfMipmapLevels;
+    quint32 bytesOfKeyValueData;
+};
+
+static_assert(sizeof(Header) == 64, "unexpected KTX header size");
+
+Header makeHeader(quint32 internalFormat, int width, int height, int layers, int mipLevels);
+bool isCompressed(quint32 internalFormat);
+qint64 imageSize(quint32 internalFormat, int width, int height);
+
+} // namespace KtxFormat
+
+/**
+ * @brief Read-only view of a KTX file holding a 2D (array) texture with a mip chain.
+ *
+ * The file is memory-mapped when possible (plain files and uncompressed resources) and the
+ * level pointers point straight into the mapping, so mip levels can be uploaded without
+ * decoding or copying.
+ */
+class KtxFile
+{
+public:
+    KtxFile();
+    ~KtxFile();
+
+    bool open(const QString &path);
+    void close();
+    QString errorString() const { return error; }
+
+    const KtxFormat::Header &header() const { return head; }
+    int width(int level) const { return std::max(1, int(head.pixelWidth) >> level); }
+    int height(int level) const { return std::max(1, int(head.pixelHeight) >> level); }
+    int layers() const { return std::max(1, int(head.numberOfArrayElements)); }
+    int levelCount() const { return levels.size(); }
+    const uchar *layerData(int level, int layer, qint64 *bytes) const;
+
+    static bool write(const QString &path, const KtxFormat::Header &header,
+                      const QList<QByteArray> &levelData, QString *errorMessage = nullptr);
+
+private:
+    struct Level
+    {
+        qint64 offset;    ///< Offset of the level's first layer.
+        qint64 layerSize; ///< Bytes per layer.
+    };
+
+    bool fail(const QString &message);
+
+    QFile file;
+    QByteArray buffer; ///< File contents when the file cannot be mapped.
+    const uchar *data;
+    qint64 size;
+    KtxFormat::Header head;
+    QList<Level> levels;
+    QString error;
+};
+
+#endif // KTXFILE_H
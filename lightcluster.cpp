@@ -0,0 +1,330 @@
+/**
+ * @file lightcluster.cpp
+ * @brief Implementation of clustered forward lighting.
+ *
+ * The view frustum is divided into a TilesX × TilesY × SlicesZ grid of clusters (screen
+ * tiles in x/y, exponential depth slices in z). Every frame the point and spot lights are
+ * binned on the CPU into the clusters their bounding sphere overlaps. The result is uploaded
+ * as three textures:
+ * - the light data (four RGBA32F texels per light),
+ * - the cluster grid (an (offset, count) pair per cluster),
+ * - the flat list of light indices referenced by the cluster grid.
+ *
+ * The fragment shader looks up its own cluster and only evaluates the lights listed there,
+ * so shading cost depends on local light density rather than on the total light count.
+ */
+
+#include "lightcluster.h"
+#include "framearena.h"
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLTexture>
+#include <QVector4D>
+#include <QtMath>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+/**
+ * @brief Creates a point light.
+ * @param position World-space position.
+ * @param range Radius of influence.
+ * @param color Light color.
+ * @param intensity Scalar multiplier applied to the color.
+ * @return The light.
+ */
+Light Light::point(const QVector3D &position, float range,
+                   const QVector3D &color, float intensity)
+{
+    Light light;
+    std::memset(&light, 0, sizeof(light));
+    light.position[0] = position.x();
+    light.position[1] = position.y();
+    light.position[2] = position.z();
+    light.range = range;
+    light.color[0] = color.x();
+    light.color[1] = color.y();
+    light.color[2] = color.z();
+    light.intensity = intensity;
+    light.direction[2] = -1.0f;
+    light.type = Point;
+    light.cosInner = -1.0f;
+    light.cosOuter = -1.0f;
+    return light;
+}
+
+/**
+ * @brief Creates a spot light.
+ * @param position World-space position.
+ * @param direction Direction the spot points to.
+ * @param range Radius of influence.
+ * @param innerAngle Half angle (degrees) of the full-intensity cone.
+ * @param outerAngle Half angle (degrees) at which the light is cut off.
+ * @param color Light color.
+ * @param intensity Scalar multiplier applied to the color.
+ * @return The light.
+ */
+Light Light::spot(const QVector3D &position, const QVector3D &direction, float range,
+                  float innerAngle, float outerAngle,
+                  const QVector3D &color, float intensity)
+{
+    Light light = point(position, range, color, intensity);
+    const QVector3D dir = direction.normalized();
+    light.direction[0] = dir.x();
+    light.direction[1] = dir.y();
+    light.direction[2] = dir.z();
+    light.type = Spot;
+    light.cosInner = std::cos(qDegreesToRadians(innerAngle));
+    light.cosOuter = std::cos(qDegreesToRadians(outerAngle));
+    return light;
+}
+
+/**
+ * @brief Constructs an empty light set. GL resources are created in initializeGL().
+ */
+ClusteredLights::ClusteredLights()
+    : indexTotal(0),
+      indexRows(0),
+      depthScale(1.0f),
+      depthBias(0.0f),
+      lightsDirty(true),
+      lightTexture(nullptr),
+      clusterTexture(nullptr),
+      indexTexture(nullptr)
+{
+    clusterRecords.fill(0, ClusterCount * 2);
+}
+
+/**
+ * @brief Destroys the light set. The GL context must be current if destroyGL() was not
+ * called before.
+ */
+ClusteredLights::~ClusteredLights()
+{
+    destroyGL();
+}
+
+/**
+ * @brief Allocates the light and cluster textures. Must be called with a current context.
+ */
+void ClusteredLights::initializeGL()
+{
+    lightTexture = new QOpenGLTexture(QOpenGLTexture::Target2D);
+    lightTexture->setFormat(QOpenGLTexture::RGBA32F);
+    lightTexture->setSize(4, MaxLights);
+    lightTexture->setMipLevels(1);
+    lightTexture->setMinMagFilters(QOpenGLTexture::Nearest, QOpenGLTexture::Nearest);
+    lightTexture->allocateStorage(QOpenGLTexture::RGBA, QOpenGLTexture::Float32);
+
+    clusterTexture = new QOpenGLTexture(QOpenGLTexture::Target2D);
+    clusterTexture->setFormat(QOpenGLTexture::RG32U);
+    clusterTexture->setSize(TilesX * TilesY, SlicesZ);
+    clusterTexture->setMipLevels(1);
+    clusterTexture->setMinMagFilters(QOpenGLTexture::Nearest, QOpenGLTexture::Nearest);
+    clusterTexture->allocateStorage(QOpenGLTexture::RG_Integer, QOpenGLTexture::UInt32);
+
+    ensureIndexCapacity(1);
+    lightsDirty = true;
+}
+
+/**
+ * @brief Releases the GL textures. Must be called with a current context.
+ */
+void ClusteredLights::destroyGL()
+{
+    delete lightTexture;
+    delete clusterTexture;
+    delete indexTexture;
+    lightTexture = nullptr;
+    clusterTexture = nullptr;
+    indexTexture = nullptr;
+    indexRows = 0;
+}
+
+/**
+ * @brief Replaces the set of lights. Lights beyond MaxLights are ignored.
+ * @param lights The new lights.
+ */
+void ClusteredLights::setLights(const QList<Light> &lights)
+{
+    lightList = lights.mid(0, MaxLights);
+    lightsDirty = true;
+}
+
+/**
+ * @brief Returns the depth slice containing a view-space depth, matching the shader's
+ * exponential slicing.
+ */
+int ClusteredLights::sliceForDepth(float depth) const
+{
+    const int slice = int(std::floor(std::log(depth) * depthScale + depthBias));
+    return std::clamp(slice, 0, SlicesZ - 1);
+}
+
+/**
+ * @brief Computes the range of clusters overlapped by a light's bounding sphere.
+ *
+ * The depth range comes directly from the sphere. The screen range is the projection of the
+ * sphere's view-space bounding box, which is conservative; when the sphere crosses the near
+ * plane the whole screen is used. Spot lights are bounded by the same sphere as point lights.
+ */
+ClusteredLights::ClusterBounds ClusteredLights::computeBounds(const Light &light,
+                                                              const QMatrix4x4 &view,
+                                                              const QMatrix4x4 &projection,
+                                                              float zNear, float zFar) const
+{
+    ClusterBounds bounds {0, TilesX - 1, 0, TilesY - 1, 0, SlicesZ - 1, false};
+    const QVector3D center = view.map(QVector3D(light.position[0], light.position[1], light.position[2]));
+    const float r = light.range;
+    const float depth = -center.z();
+    const float dMin = depth - r;
+    const float dMax = depth + r;
+    if (dMax < zNear || dMin > zFar)
+        return bounds;
+
+    bounds.z0 = qint16(sliceForDepth(std::max(dMin, zNear)));
+    bounds.z1 = qint16(sliceForDepth(std::min(dMax, zFar)));
+
+    if (dMin > zNear) {
+        float minX = std::numeric_limits<float>::max(), minY = minX;
+        float maxX = -minX, maxY = -minX;
+        for (int corner = 0; corner < 8; ++corner) {
+            const QVector4D p(center.x() + ((corner & 1) ? r : -r),
+                              center.y() + ((corner & 2) ? r : -r),
+                              center.z() + ((corner & 4) ? r : -r),
+                              1.0f);
+            const QVector4D clip = projection * p;
+            const float x = clip.x() / clip.w();
+            const float y = clip.y() / clip.w();
+            minX = std::min(minX, x);
+            maxX = std::max(maxX, x);
+            minY = std::min(minY, y);
+            maxY = std::max(maxY, y);
+        }
+        if (maxX < -1.0f || minX > 1.0f || maxY < -1.0f || minY > 1.0f)
+            return bounds;
+        auto tile = [](float ndc, int tiles) {
+            return qint16(std::clamp(int((ndc * 0.5f + 0.5f) * tiles), 0, tiles - 1));
+        };
+        bounds.x0 = tile(minX, TilesX);
+        bounds.x1 = tile(maxX, TilesX);
+        bounds.y0 = tile(minY, TilesY);
+        bounds.y1 = tile(maxY, TilesY);
+    }
+    bounds.visible = true;
+    return bounds;
+}
+
+/**
+ * @brief Makes sure the index texture has at least the given number of rows.
+ *
+ * The texture grows by doubling so that it is reallocated only a handful of times.
+ */
+void ClusteredLights::ensureIndexCapacity(int rows)
+{
+    if (indexTexture && rows <= indexRows)
+        return;
+    int newRows = std::max(indexRows, 1);
+    while (newRows < rows)
+        newRows *= 2;
+    delete indexTexture;
+    indexTexture = new QOpenGLTexture(QOpenGLTexture::Target2D);
+    indexTexture->setFormat(QOpenGLTexture::R32U);
+    indexTexture->setSize(IndexRowWidth, newRows);
+    indexTexture->setMipLevels(1);
+    indexTexture->setMinMagFilters(QOpenGLTexture::Nearest, QOpenGLTexture::Nearest);
+    indexTexture->allocateStorage(QOpenGLTexture::Red_Integer, QOpenGLTexture::UInt32);
+    indexRows = newRows;
+}
+
+/**
+ * @brief Bins all lights into the cluster grid for the given camera and uploads the result.
+ * @param view The view matrix.
+ * @param projection The perspective projection matrix.
+ * @param zNear Near plane distance used by the projection.
+ * @param zFar Far plane distance used by the projection.
+ * @param arena Frame arena for the per-light cluster ranges.
+ *
+ * Binning is a two-pass counting sort: the first pass counts the lights per cluster, a
+ * prefix sum turns the counts into offsets, and the second pass writes the light indices.
+ */
+void ClusteredLights::build(const QMatrix4x4 &view, const QMatrix4x4 &projection,
+                            float zNear, float zFar, FrameArena &arena)
+{
+    depthScale = SlicesZ / std::log(zFar / zNear);
+    depthBias = -std::log(zNear) * depthScale;
+
+    std::fill(clusterRecords.begin(), clusterRecords.end(), 0u);
+    ClusterBounds *lightBounds = arena.allocateArray<ClusterBounds>(lightList.size());
+    for (int i = 0; i < lightList.size(); ++i) {
+        const ClusterBounds b = computeBounds(lightList[i], view, projection, zNear, zFar);
+        lightBounds[i] = b;
+        if (!b.visible)
+            continue;
+        for (int z = b.z0; z <= b.z1; ++z)
+            for (int y = b.y0; y <= b.y1; ++y)
+                for (int x = b.x0; x <= b.x1; ++x)
+                    ++clusterRecords[2 * ((z * TilesY + y) * TilesX + x) + 1];
+    }
+
+    quint32 offset = 0;
+    for (int c = 0; c < ClusterCount; ++c) {
+        clusterRecords[2 * c] = offset;
+        offset += clusterRecords[2 * c + 1];
+        clusterRecords[2 * c + 1] = 0;
+    }
+    indexTotal = int(offset);
+
+    const int rows = std::max(1, (indexTotal + IndexRowWidth - 1) / IndexRowWidth);
+    lightIndices.resize(rows * IndexRowWidth);
+    for (int i = 0; i < lightList.size(); ++i) {
+        const ClusterBounds &b = lightBounds[i];
+        if (!b.visible)
+            continue;
+        for (int z = b.z0; z <= b.z1; ++z)
+            for (int y = b.y0; y <= b.y1; ++y)
+                for (int x = b.x0; x <= b.x1; ++x) {
+                    quint32 *record = &clusterRecords[2 * ((z * TilesY + y) * TilesX + x)];
+                    lightIndices[record[0] + record[1]++] = quint32(i);
+                }
+    }
+
+    if (!clusterTexture)
+        return;
+    if (lightsDirty && !lightList.isEmpty()) {
+        lightTexture->setData(0, 0, 0, 4, lightList.size(), 1,
+                              QOpenGLTexture::RGBA, QOpenGLTexture::Float32,
+                              lightList.constData());
+    }
+    lightsDirty = false;
+    clusterTexture->setData(0, 0, 0, TilesX * TilesY, SlicesZ, 1,
+                            QOpenGLTexture::RG_Integer, QOpenGLTexture::UInt32,
+                            clusterRecords.constData());
+    if (indexTotal > 0) {
+        ensureIndexCapacity(rows);
+        indexTexture->setData(0, 0, 0, IndexRowWidth, rows, 1,
+                              QOpenGLTexture::Red_Integer, QOpenGLTexture::UInt32,
+                              lightIndices.constData());
+    }
+}
+
+/**
+ * @brief Binds the cluster textures and sets the matching uniforms on a program.
+ * @param program The (already bound) shader program.
+ * @param firstUnit First of the three consecutive texture units to use.
+ */
+void ClusteredLights::bind(QOpenGLShaderProgram &program, int firstUnit)
+{
+    lightTexture->bind(firstUnit);
+    clusterTexture->bind(firstUnit + 1);
+    indexTexture->bind(firstUnit + 2);
+    program.setUniformValue("uLightData", firstUnit);
+    program.setUniformValue("uClusterGrid", firstUnit + 1);
+    program.setUniformValue("uLightIndices", firstUnit + 2);
+    program.setUniformValue("uClusterDepth", depthScale, depthBias);
+    QOpenGLContext::currentContext()->functions()->glUniform3i(
+        program.uniformLocation("uClusterDims"), TilesX, TilesY, SlicesZ);
+    program.setUniformValue("uIndexRowWidth", IndexRowWidth);
+}
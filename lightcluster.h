@@ -0,0 +1,90 @@
+#ifndef LIGHTCLUSTER_H
+#define LIGHTCLUSTER_H
+
+#include <QList>
+#include <QMatrix4x4>
+#include <QVector3D>
+#include <QtGlobal>
+
+class FrameArena;
+class QOpenGLShaderProgram;
+class QOpenGLTexture;
+
+/**
+ * @brief A point or spot light, laid out exactly as it is uploaded to the GPU
+ * (four RGBA32F texels per light).
+ */
+struct Light
+{
+    enum Type { Point = 0, Spot = 1 };
+
+    float position[3];
+    float range;        ///< Distance at which the light's contribution reaches zero.
+    float color[3];
+    float intensity;
+    float direction[3]; ///< Spot direction (unused for point lights).
+    float type;         ///< Light::Type stored as float so the texel stays RGBA32F.
+    float cosInner;     ///< Cosine of the full-intensity spot cone half angle.
+    float cosOuter;     ///< Cosine of the spot cutoff half angle.
+    float reserved[2];
+
+    static Light point(const QVector3D &position, float range,
+                       const QVector3D &color, float intensity);
+    static Light spot(const QVector3D &position, const QVector3D &direction, float range,
+                      float innerAngle, float outerAngle,
+                      const QVector3D &color, float intensity);
+};
+
+static_assert(sizeof(Light) == 64, "Light must match the four-texel GPU layout");
+
+class ClusteredLights
+{
+public:
+    static constexpr int TilesX = 16;
+    static constexpr int TilesY = 9;
+    static constexpr int SlicesZ = 24;
+    static constexpr int ClusterCount = TilesX * TilesY * SlicesZ;
+    static constexpr int MaxLights = 1024;
+    static constexpr int IndexRowWidth = 1024;
+
+    ClusteredLights();
+    ~ClusteredLights();
+
+    void initializeGL();
+    void destroyGL();
+
+    void setLights(const QList<Light> &lights);
+    const QList<Light> &lights() const { return lightList; }
+    int lightCount() const { return lightList.size(); }
+    int indexCount() const { return indexTotal; }
+
+    void build(const QMatrix4x4 &view, const QMatrix4x4 &projection, float zNear, float zFar,
+               FrameArena &arena);
+    void bind(QOpenGLShaderProgram &program, int firstUnit);
+
+private:
+    struct ClusterBounds
+    {
+        qint16 x0, x1, y0, y1, z0, z1;
+        bool visible;
+    };
+
+    ClusterBounds computeBounds(const Light &light, const QMatrix4x4 &view,
+                                const QMatrix4x4 &projection, float zNear, float zFar) const;
+    int sliceForDepth(float depth) const;
+    void ensureIndexCapacity(int rows);
+
+    QList<Light> lightList;
+    QList<quint32> clusterRecords; ///< (offset, count) pair per cluster.
+    QList<quint32> lightIndices;
+    int indexTotal;
+    int indexRows;
+    float depthScale;
+    float depthBias;
+    bool lightsDirty;
+    QOpenGLTexture *lightTexture;
+    QOpenGLTexture *clusterTexture;
+    QOpenGLTexture *indexTexture;
+};
+
+#endif // LIGHTCLUSTER_H
@@ -9,8 +9,12 @@
 
 #include "dialogs.h"
 #include "cubewidget.h"
+#include "tracerecorder.h"
+#include "renderserver.h"
+#include "allocstats.h"
 
 #include <QApplication>
+#include <QGuiApplication>
 #include <QMainWindow>
 #include <QOpenGLWidget>
 #include <QOpenGLFunctions>
@@ -38,13 +42,18 @@
 #include <QQuaternion>
 #include <QWheelEvent>
 #include <QIcon>
+#include <QFileDialog>
+#include <QMessageBox>
+#include <QCommandLineParser>
+#include <memory>
 
 /**
  * @brief MainWindow class that provides the main interface and menu for the application.
  *
  * MainWindow creates and displays the CubeWidget along with a menu for accessing
- * different functionalities such as line rotation, view position, default view, animation,
- * and toggling the gloss effect.
+ * different functionalities such as line rotation, view position, default view, animation
+ * (including continuous rotation about a line), toggling the gloss effect, toggling the
+ * scattered lights, and opening/saving scene files.
  */
 class MainWindow : public QMainWindow {
     Q_OBJECT
@@ -72,21 +81,39 @@ public:
         QAction *viewPosAct = new QAction("View Position", this);
         QAction *defaultPosAct = new QAction("Default Position", this);
         QAction *animAct = new QAction("Animation", this);
+        QAction *lineAnimAct = new QAction("Line Animation", this);
         QAction *glossAct = new QAction("Toggle Gloss", this);
+        QAction *lightsAct = new QAction("Toggle Lights", this);
+        QAction *openSceneAct = new QAction("Open Scene...", this);
+        QAction *saveSceneAct = new QAction("Save Scene...", this);
 
         menu->addAction(lineRotAct);
         menu->addAction(viewPosAct);
         menu->addAction(defaultPosAct);
         menu->addAction(animAct);
+        menu->addAction(lineAnimAct);
         menu->addAction(glossAct);
+        menu->addAction(lightsAct);
+        menu->addSeparator();
+        menu->addAction(openSceneAct);
+        menu->addAction(saveSceneAct);
 
         // Connect menu actions to their corresponding slots.
         connect(lineRotAct, &QAction::triggered, this, &MainWindow::onLineRotation);
         connect(viewPosAct, &QAction::triggered, this, &MainWindow::onViewPosition);
         connect(defaultPosAct, &QAction::triggered, cubeWidget, &CubeWidget::resetDefault);
         connect(animAct, &QAction::triggered, cubeWidget, &CubeWidget::toggleAnimation);
+        connect(lineAnimAct, &QAction::triggered, this, &MainWindow::onLineAnimation);
         connect(glossAct, &QAction::triggered, cubeWidget, &CubeWidget::toggleGloss);
+        connect(lightsAct, &QAction::triggered, cubeWidget, &CubeWidget::toggleLights);
+        connect(openSceneAct, &QAction::triggered, this, &MainWindow::onOpenScene);
+        connect(saveSceneAct, &QAction::triggered, this, &MainWindow::onSaveScene);
     }
+
+    /**
+     * @brief Returns the cube rendering widget.
+     */
+    CubeWidget *cubeView() const { return cubeWidget; }
 private slots:
     /**
      * @brief Slot called when the "Line Rotation" action is triggered.
@@ -105,6 +132,19 @@ private slots:
         }
     }
 
+    /**
+     * @brief Slot called when the "Line Animation" action is triggered.
+     *
+     * Opens the LineRotationDialog and, if accepted, makes the selected cube orbit the line
+     * continuously, the angle being the speed in degrees per animation tick.
+     */
+    void onLineAnimation() {
+        LineRotationDialog dlg(this, QVector3D(0, 0, 0), QVector3D(0, 0, 1), 1.0f);
+        dlg.setWindowTitle("Line Animation");
+        if (dlg.exec() == QDialog::Accepted)
+            cubeWidget->setLineAnimation(dlg.getB(), dlg.getD(), dlg.getAngle());
+    }
+
     /**
      * @brief Slot called when the "View Position" action is triggered.
      *
@@ -116,26 +156,168 @@ private slots:
             cubeWidget->setViewPosition(dlg.getEye(), dlg.getPoint());
         }
     }
+
+    /**
+     * @brief Slot called when the "Open Scene..." action is triggered.
+     *
+     * Asks for a scene file and replaces the current scene with its contents.
+     */
+    void onOpenScene() {
+        QString path = QFileDialog::getOpenFileName(this, "Open Scene", QString(), "Cube scenes (*.cubescene)");
+        if (path.isEmpty())
+            return;
+        QString error;
+        if (!cubeWidget->loadScene(path, &error))
+            QMessageBox::warning(this, "Open Scene", QString("Could not load %1:\n%2").arg(path, error));
+    }
+
+    /**
+     * @brief Slot called when the "Save Scene..." action is triggered.
+     *
+     * Asks for a file name and writes the current scene to it.
+     */
+    void onSaveScene() {
+        QString path = QFileDialog::getSaveFileName(this, "Save Scene", QString(), "Cube scenes (*.cubescene)");
+        if (path.isEmpty())
+            return;
+        QString error;
+        if (!cubeWidget->saveScene(path, &error))
+            QMessageBox::warning(this, "Save Scene", QString("Could not save %1:\n%2").arg(path, error));
+    }
 private:
     CubeWidget *cubeWidget; ///< Pointer to the cube rendering widget.
 };
 
 #include "main.moc"
 
+/**
+ * @brief Returns true if the command line asks for the render server.
+ *
+ * Checked before the application object is created, because server mode uses a
+ * QGuiApplication: it creates no widgets and must start without a windowing system.
+ */
+static bool isServerMode(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+        const QByteArray arg(argv[i]);
+        if (arg == "--server" || arg.startsWith("--server="))
+            return true;
+    }
+    return false;
+}
+
 /**
  * @brief Main entry point of the application.
  *
  * Initializes the QApplication, creates and displays the MainWindow, and starts
- * the event loop.
+ * the event loop. Command line options allow loading a scene at startup, recording a
+ * trace of the session, and replaying a trace to collect frame statistics:
+ * - `--scene <file>` loads a scene file.
+ * - `--record <file>` records input, menu actions, timer ticks and frames.
+ * - `--replay <file>` replays a trace in real time (or as fast as possible with `--fast`),
+ *   prints the frame statistics and exits; `--stats <file>` also writes per-frame times.
+ *   `--fail-on-alloc` makes the exit status 1 if any frame after the first `--warmup`
+ *   frames (default 10) allocated heap memory; it needs a build with allocation tracking.
+ * - `--server <name>` starts the headless render server on a local socket instead of the
+ *   window (see RenderServer); `--scene` then loads the server's scene. Server mode uses a
+ *   QGuiApplication and, unless QT_QPA_PLATFORM says otherwise, the offscreen platform
+ *   plugin, so it runs on hosts without a display.
  *
  * @param argc Argument count.
  * @param argv Argument vector.
  * @return int Exit status.
  */
 int main(int argc, char *argv[]){
-    QApplication app(argc, argv);
+    const bool serverMode = isServerMode(argc, argv);
+    if (serverMode && qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    std::unique_ptr<QGuiApplication> app(serverMode ? new QGuiApplication(argc, argv)
+                                                    : new QApplication(argc, argv));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Cube Rotation Visualization");
+    parser.addHelpOption();
+    QCommandLineOption sceneOption("scene", "Load a scene file at startup.", "file");
+    QCommandLineOption recordOption("record", "Record the session to a trace file.", "file");
+    QCommandLineOption replayOption("replay", "Replay a trace file, print frame statistics and exit.", "file");
+    QCommandLineOption fastOption("fast", "Replay as fast as possible instead of in real time.");
+    QCommandLineOption statsOption("stats", "Write per-frame replay times to a CSV file.", "file");
+    QCommandLineOption failOnAllocOption("fail-on-alloc", "Fail the replay if steady-state frames allocate heap memory.");
+    QCommandLineOption warmupOption("warmup", "Frames excluded from the allocation check (default 10).", "frames", "10");
+    QCommandLineOption serverOption("server", "Run headless, serving render commands on a local socket.", "name");
+    parser.addOptions({sceneOption, recordOption, replayOption, fastOption, statsOption, failOnAllocOption,
+                       warmupOption, serverOption});
+    parser.process(*app);
+
+    if (parser.isSet(failOnAllocOption) && !AllocStats::isEnabled()) {
+        qCritical() << "--fail-on-alloc needs a build with allocation tracking (qmake CONFIG+=alloc_tracking)";
+        return 1;
+    }
+
+    if (serverMode) {
+        RenderServer server;
+        QString error;
+        if (parser.isSet(sceneOption) && !server.scene().load(parser.value(sceneOption), &error)) {
+            qCritical().noquote() << "Could not load scene:" << error;
+            return 1;
+        }
+        if (!server.start(parser.value(serverOption), &error)) {
+            qCritical().noquote() << "Could not start render server:" << error;
+            return 1;
+        }
+        qInfo().noquote() << "Render server listening on" << parser.value(serverOption);
+        return app->exec();
+    }
+
     MainWindow win;
     win.resize(800, 600);
+    CubeWidget *cubeWidget = win.cubeView();
+
+    if (parser.isSet(sceneOption)) {
+        QString error;
+        if (!cubeWidget->loadScene(parser.value(sceneOption), &error)) {
+            qCritical().noquote() << "Could not load scene:" << error;
+            return 1;
+        }
+    }
+
+    TraceRecorder recorder;
+    if (parser.isSet(recordOption)) {
+        if (!recorder.open(parser.value(recordOption))) {
+            qCritical().noquote() << "Could not record trace:" << recorder.errorString();
+            return 1;
+        }
+        cubeWidget->setTraceRecorder(&recorder);
+    }
+
+    TraceReplayer replayer(cubeWidget);
+    if (parser.isSet(replayOption)) {
+        QString error;
+        if (!replayer.load(parser.value(replayOption), &error)) {
+            qCritical().noquote() << "Could not load trace:" << error;
+            return 1;
+        }
+        QObject::connect(&replayer, &TraceReplayer::finished, app.get(), [&]() {
+            const FrameStatistics &stats = replayer.statistics();
+            const int warmup = parser.value(warmupOption).toInt();
+            qInfo().noquote() << stats.summary();
+            if (AllocStats::isEnabled())
+                qInfo().noquote() << stats.allocationSummary(warmup);
+            if (parser.isSet(statsOption) && !stats.writeCsv(parser.value(statsOption)))
+                qWarning().noquote() << "Could not write" << parser.value(statsOption);
+            if (parser.isSet(failOnAllocOption) && stats.allocatingFrames(warmup) > 0) {
+                qCritical() << "Steady-state frames allocated heap memory";
+                app->exit(1);
+                return;
+            }
+            app->exit(0);
+        });
+    }
+
     win.show();
-    return app.exec();
+    if (parser.isSet(replayOption))
+        replayer.start(parser.isSet(fastOption) ? TraceReplayer::AsFastAsPossible : TraceReplayer::RealTime);
+    const int status = app->exec();
+    cubeWidget->setTraceRecorder(nullptr);
+    return status;
 }
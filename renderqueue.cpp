@@ -0,0 +1,339 @@
+/**
+ * @file renderqueue.cpp
+ * @brief Implementation of the sorted render queue.
+ *
+ * Draws are not issued immediately. Each draw is recorded as a DrawPacket with a 64-bit sort
+ * key, and flush() radix-sorts the packets and executes them while tracking the current pass
+ * state, the bound program, texture (unit 0) and VAO and the model matrix, so a bind or
+ * uniform upload is only issued when the state actually changes.
+ *
+ * Sort key layout (most significant bits first):
+ * | bits  | field                                                        |
+ * |-------|--------------------------------------------------------------|
+ * | 60-63 | pass (opaque, transparent, overlay)                          |
+ * | 52-59 | program id                                                   |
+ * | 40-51 | texture id (0xFFF = no texture)                              |
+ * | 32-39 | VAO id                                                       |
+ * | 0-31  | view depth (front-to-back, back-to-front for transparent)    |
+ *
+ * Overlay packets have no meaningful depth; their producers pass the draw order instead.
+ */
+
+#include "renderqueue.h"
+#include "framearena.h"
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLTexture>
+#include <QOpenGLVertexArrayObject>
+#include <bitset>
+#include <cstring>
+#include <utility>
+
+namespace {
+constexpr int kPassShift = 60;
+constexpr int kProgramShift = 52;
+constexpr int kTextureShift = 40;
+constexpr int kVaoShift = 32;
+constexpr quint64 kNoTexture = 0xFFF;
+constexpr int kMaxPrograms = 256; // 8 key bits
+constexpr int kMaxTextures = 0xFFF; // 12 key bits, the last value means no texture
+constexpr int kMaxVaos = 256; // 8 key bits
+constexpr int kRadixBits = 8;
+constexpr int kRadixBuckets = 1 << kRadixBits;
+constexpr int kRadixPasses = 64 / kRadixBits;
+}
+
+/**
+ * @brief Builds a sort key.
+ * @param pass Render pass; packets of an earlier pass are always drawn first.
+ * @param programId Id returned by registerProgram().
+ * @param textureId Id returned by registerTexture(), or -1 for no texture.
+ * @param vaoId Id returned by registerVao().
+ * @param depth View-space depth (distance along the view direction).
+ * @return The 64-bit key.
+ *
+ * Non-negative floats compare like their bit patterns, so the depth is stored as raw bits.
+ * Transparent packets invert the depth bits to sort back-to-front.
+ */
+quint64 RenderQueue::makeKey(Pass pass, int programId, int textureId, int vaoId, float depth)
+{
+    if (!(depth > 0.0f))
+        depth = 0.0f;
+    quint32 depthBits;
+    std::memcpy(&depthBits, &depth, sizeof(depthBits));
+    if (pass == Transparent)
+        depthBits = ~depthBits;
+    const quint64 texture = textureId < 0 ? kNoTexture : (quint64(textureId) & kNoTexture);
+    return (quint64(pass & 0xF) << kPassShift)
+         | (quint64(programId & 0xFF) << kProgramShift)
+         | (texture << kTextureShift)
+         | (quint64(vaoId & 0xFF) << kVaoShift)
+         | quint64(depthBits);
+}
+
+/**
+ * @brief Constructs an empty render queue.
+ */
+RenderQueue::RenderQueue()
+{
+    std::memset(&frameStats, 0, sizeof(frameStats));
+}
+
+/**
+ * @brief Registers a shader program.
+ * @param program The program.
+ * @param setup Called once per frame, right after the program is first bound, to set the
+ * uniforms shared by all packets using it.
+ * @return The program id to use in makeKey(). At most 256 programs fit in the key.
+ */
+int RenderQueue::registerProgram(QOpenGLShaderProgram *program, const ProgramSetup &setup)
+{
+    Q_ASSERT(programs.size() < kMaxPrograms);
+    programs.append({program, setup,
+                     program->uniformLocation("mvp"),
+                     program->uniformLocation("model")});
+    return programs.size() - 1;
+}
+
+/**
+ * @brief Registers a texture to be bound on unit 0.
+ * @return The texture id to use in makeKey(). At most 4095 textures fit in the key.
+ */
+int RenderQueue::registerTexture(QOpenGLTexture *texture)
+{
+    Q_ASSERT(textures.size() < kMaxTextures);
+    textures.append(texture);
+    return textures.size() - 1;
+}
+
+/**
+ * @brief Points a registered texture id at another texture (e.g. a recreated one), keeping
+ * the id valid in keys that are already built.
+ */
+void RenderQueue::replaceTexture(int textureId, QOpenGLTexture *texture)
+{
+    textures[textureId] = texture;
+}
+
+/**
+ * @brief Registers a vertex array object.
+ * @return The VAO id to use in makeKey(). At most 256 VAOs fit in the key.
+ */
+int RenderQueue::registerVao(QOpenGLVertexArrayObject *vao)
+{
+    Q_ASSERT(vaos.size() < kMaxVaos);
+    vaos.append(vao);
+    return vaos.size() - 1;
+}
+
+/**
+ * @brief Forgets all registered programs, textures and VAOs (e.g. when they are recreated).
+ */
+void RenderQueue::clearRegistrations()
+{
+    programs.clear();
+    textures.clear();
+    vaos.clear();
+    packets.clear();
+}
+
+/**
+ * @brief Sets the view-projection matrix used to compute each packet's "mvp" uniform.
+ */
+void RenderQueue::setViewProjection(const QMatrix4x4 &viewProjection)
+{
+    viewProj = viewProjection;
+}
+
+/**
+ * @brief Records a draw for the current frame.
+ */
+void RenderQueue::submit(const DrawPacket &packet)
+{
+    packets.append(packet);
+}
+
+/**
+ * @brief Sorts the recorded packets by key.
+ * @return The sorted (key, packet index) pairs, in frame arena memory.
+ */
+const RenderQueue::SortEntry *RenderQueue::sortPackets(FrameArena &arena)
+{
+    const int n = packets.size();
+    SortEntry *entries = arena.allocateArray<SortEntry>(n);
+    for (int i = 0; i < n; ++i)
+        entries[i] = {packets[i].key, i};
+    return sortByKey(entries, n, arena);
+}
+
+/**
+ * @brief Sorts entries by key, keeping entries with equal keys in their original order.
+ * @param entries The entries; used as one of the two scatter buffers.
+ * @param count Number of entries.
+ * @param arena Provides the second scatter buffer.
+ * @return The sorted entries: either entries itself or the arena buffer.
+ *
+ * LSD radix sort on 8-bit digits. The histograms for all digits are built in a single sweep,
+ * and a digit is skipped when every key shares the same value for it (typically most of the
+ * id bits), so a frame usually needs far fewer than eight scatter passes.
+ */
+const RenderQueue::SortEntry *RenderQueue::sortByKey(SortEntry *entries, int count, FrameArena &arena)
+{
+    const int n = count;
+    if (n < 2)
+        return entries;
+
+    int histograms[kRadixPasses][kRadixBuckets];
+    std::memset(histograms, 0, sizeof(histograms));
+    for (int i = 0; i < n; ++i) {
+        const quint64 key = entries[i].key;
+        for (int pass = 0; pass < kRadixPasses; ++pass)
+            ++histograms[pass][(key >> (pass * kRadixBits)) & (kRadixBuckets - 1)];
+    }
+
+    SortEntry *src = entries;
+    SortEntry *dst = arena.allocateArray<SortEntry>(n);
+    for (int pass = 0; pass < kRadixPasses; ++pass) {
+        const int shift = pass * kRadixBits;
+        int *counts = histograms[pass];
+        if (counts[(src[0].key >> shift) & (kRadixBuckets - 1)] == n)
+            continue;
+        int offset = 0;
+        for (int b = 0; b < kRadixBuckets; ++b) {
+            const int c = counts[b];
+            counts[b] = offset;
+            offset += c;
+        }
+        for (int i = 0; i < n; ++i)
+            dst[counts[(src[i].key >> shift) & (kRadixBuckets - 1)]++] = src[i];
+        std::swap(src, dst);
+    }
+    return src;
+}
+
+/**
+ * @brief Sets the fixed-function state of a pass.
+ *
+ * Opaque draws depth-tested and culled without blending; transparent draws blend and test
+ * depth without writing it; overlay draws blend over everything, with neither depth testing
+ * nor culling.
+ */
+void RenderQueue::applyPassState(QOpenGLExtraFunctions *gl, int pass)
+{
+    if (pass == Overlay) {
+        gl->glDisable(GL_DEPTH_TEST);
+        gl->glDisable(GL_CULL_FACE);
+    } else {
+        gl->glEnable(GL_DEPTH_TEST);
+        gl->glEnable(GL_CULL_FACE);
+    }
+    gl->glDepthMask(pass == Opaque ? GL_TRUE : GL_FALSE);
+    if (pass == Opaque) {
+        gl->glDisable(GL_BLEND);
+    } else {
+        gl->glEnable(GL_BLEND);
+        gl->glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    }
+}
+
+/**
+ * @brief Sorts and executes all packets recorded since the last flush.
+ * @param gl Function resolver of the current context.
+ * @param arena Frame arena for the sort buffers.
+ *
+ * The bound program, texture and VAO are assumed unknown at the start of each flush, so the
+ * first packet always binds everything. The pass state is expected to be the opaque one, and
+ * is restored to it before returning.
+ */
+void RenderQueue::flush(QOpenGLExtraFunctions *gl, FrameArena &arena)
+{
+    std::memset(&frameStats, 0, sizeof(frameStats));
+    frameStats.packets = packets.size();
+    const SortEntry *sorted = sortPackets(arena);
+
+    int currentPass = Opaque;
+    int currentProgram = -1;
+    quint64 currentTexture = ~quint64(0);
+    int currentVao = -1;
+    QMatrix4x4 currentModel;
+    std::bitset<kMaxPrograms> programsSetUp;
+    QOpenGLVertexArrayObject *boundVao = nullptr;
+
+    for (int i = 0; i < frameStats.packets; ++i) {
+        const DrawPacket &packet = packets.at(sorted[i].packet);
+        const int pass = int(packet.key >> kPassShift);
+        const int programId = int((packet.key >> kProgramShift) & 0xFF);
+        const quint64 textureId = (packet.key >> kTextureShift) & kNoTexture;
+        const int vaoId = int((packet.key >> kVaoShift) & 0xFF);
+        const ProgramEntry &program = programs.at(programId);
+
+        if (pass != currentPass) {
+            applyPassState(gl, pass);
+            currentPass = pass;
+            ++frameStats.stateChanges;
+        }
+
+        const bool programChanged = programId != currentProgram;
+        if (programChanged) {
+            program.program->bind();
+            currentProgram = programId;
+            ++frameStats.programBinds;
+            ++frameStats.stateChanges;
+            if (!programsSetUp.test(programId)) {
+                programsSetUp.set(programId);
+                if (program.setup)
+                    program.setup(*program.program);
+            }
+        } else {
+            ++frameStats.redundantSkipped;
+        }
+
+        if (textureId != currentTexture) {
+            if (textureId != kNoTexture)
+                textures[int(textureId)]->bind(0);
+            currentTexture = textureId;
+            ++frameStats.textureBinds;
+            ++frameStats.stateChanges;
+        } else {
+            ++frameStats.redundantSkipped;
+        }
+
+        if (vaoId != currentVao) {
+            boundVao = vaos[vaoId];
+            boundVao->bind();
+            currentVao = vaoId;
+            ++frameStats.vaoBinds;
+            ++frameStats.stateChanges;
+        } else {
+            ++frameStats.redundantSkipped;
+        }
+
+        // mvp follows from the model matrix, as the view-projection is fixed for the flush.
+        if (programChanged || packet.model != currentModel) {
+            currentModel = packet.model;
+            if (program.mvpLocation >= 0) {
+                program.program->setUniformValue(program.mvpLocation, viewProj * packet.model);
+                ++frameStats.uniformUpdates;
+                ++frameStats.stateChanges;
+            }
+            if (program.modelLocation >= 0) {
+                program.program->setUniformValue(program.modelLocation, packet.model);
+                ++frameStats.uniformUpdates;
+                ++frameStats.stateChanges;
+            }
+        } else {
+            ++frameStats.redundantSkipped;
+        }
+        if (packet.instanceCount > 1)
+            gl->glDrawArraysInstanced(GL_TRIANGLES, packet.first, packet.count, packet.instanceCount);
+        else
+            gl->glDrawArrays(GL_TRIANGLES, packet.first, packet.count);
+        ++frameStats.draws;
+    }
+
+    if (boundVao)
+        boundVao->release();
+    if (currentPass != Opaque)
+        applyPassState(gl, Opaque);
+    packets.clear();
+}
@@ -0,0 +1,94 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <QList>
+#include <QMatrix4x4>
+#include <QtGlobal>
+#include <functional>
+
+class FrameArena;
+class QOpenGLExtraFunctions;
+class QOpenGLShaderProgram;
+class QOpenGLTexture;
+class QOpenGLVertexArrayObject;
+
+/**
+ * @brief One draw call recorded into the RenderQueue.
+ *
+ * The program, texture and VAO are not stored in the packet: they are encoded as registered
+ * ids in the sort key, so sorting by key also groups packets by GL state.
+ */
+struct DrawPacket
+{
+    quint64 key;
+    QMatrix4x4 model;
+    int first;
+    int count;
+    int instanceCount;
+};
+
+class RenderQueue
+{
+public:
+    enum Pass { Opaque = 0, Transparent = 1, Overlay = 2 };
+
+    /// Per-frame counters, reset by flush().
+    struct Stats
+    {
+        int packets;
+        int draws;
+        int programBinds;
+        int textureBinds;
+        int vaoBinds;
+        int uniformUpdates;   ///< Per-packet uniform uploads (program setup excluded).
+        int stateChanges;     ///< Pass switches, binds and uniform uploads actually issued.
+        int redundantSkipped; ///< Binds and matrix uploads skipped because they were current.
+    };
+
+    /// A packet's sort key and its index in submission order.
+    struct SortEntry
+    {
+        quint64 key;
+        int packet;
+    };
+
+    using ProgramSetup = std::function<void(QOpenGLShaderProgram &)>;
+
+    static quint64 makeKey(Pass pass, int programId, int textureId, int vaoId, float depth);
+    static const SortEntry *sortByKey(SortEntry *entries, int count, FrameArena &arena);
+
+    RenderQueue();
+
+    int registerProgram(QOpenGLShaderProgram *program, const ProgramSetup &setup);
+    int registerTexture(QOpenGLTexture *texture);
+    void replaceTexture(int textureId, QOpenGLTexture *texture);
+    int registerVao(QOpenGLVertexArrayObject *vao);
+    void clearRegistrations();
+
+    void setViewProjection(const QMatrix4x4 &viewProjection);
+    void submit(const DrawPacket &packet);
+    void flush(QOpenGLExtraFunctions *gl, FrameArena &arena);
+
+    const Stats &stats() const { return frameStats; }
+
+private:
+    struct ProgramEntry
+    {
+        QOpenGLShaderProgram *program;
+        ProgramSetup setup;
+        int mvpLocation;
+        int modelLocation;
+    };
+
+    const SortEntry *sortPackets(FrameArena &arena);
+    static void applyPassState(QOpenGLExtraFunctions *gl, int pass);
+
+    QList<ProgramEntry> programs;
+    QList<QOpenGLTexture *> textures;
+    QList<QOpenGLVertexArrayObject *> vaos;
+    QList<DrawPacket> packets;
+    QMatrix4x4 viewProj;
+    Stats frameStats;
+};
+
+#endif // RENDERQUEUE_H
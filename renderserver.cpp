@@ -0,0 +1,414 @@
+/**
+ * @file renderserver.cpp
+ * @brief Headless render server driven by batched binary commands over a local socket.
+ *
+ * The server owns a CubeScene and a CubeRenderer in an offscreen OpenGL context and listens
+ * on a QLocalServer (a Unix domain socket on Unix). Clients send batches of commands (see
+ * RenderProtocol) so that many scene edits and renders cost one socket round trip. Rendered
+ * images are read back with glReadPixels directly into a POSIX shared memory object created
+ * by the client, so pixels are never copied through the socket or an intermediate buffer.
+ *
+ * All clients share the one scene; commands from different clients are applied in the order
+ * their batches arrive.
+ */
+
+#include "renderserver.h"
+#include <QDebug>
+#include <QLocalSocket>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLFramebufferObject>
+#include <QSurfaceFormat>
+#include <cstddef>
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace RenderProtocol;
+
+/**
+ * @brief Constructs an idle server; start() creates the context and starts listening.
+ */
+RenderServer::RenderServer(QObject *parent)
+    : QObject(parent),
+      target(nullptr),
+      nextReadback(0)
+{
+    connect(&server, &QLocalServer::newConnection, this, &RenderServer::onNewConnection);
+}
+
+/**
+ * @brief Unmaps every client's shared memory and releases the GL resources.
+ */
+RenderServer::~RenderServer()
+{
+    for (Client &client : clients)
+        detachMemory(client);
+    if (context.makeCurrent(&surface)) {
+        for (Readback &readback : readbacks) {
+            if (readback.buffer)
+                context.extraFunctions()->glDeleteBuffers(1, &readback.buffer);
+        }
+        delete target;
+        renderer.destroy();
+        context.doneCurrent();
+    }
+}
+
+/**
+ * @brief Creates the offscreen OpenGL context and starts listening.
+ * @param name Socket name, or an absolute path for the Unix domain socket.
+ * @param errorMessage Receives the reason on failure (may be nullptr).
+ * @return true if the server is accepting connections.
+ */
+bool RenderServer::start(const QString &name, QString *errorMessage)
+{
+    QSurfaceFormat format;
+    format.setVersion(3, 3);
+    format.setProfile(QSurfaceFormat::CoreProfile);
+    format.setDepthBufferSize(24);
+    surface.setFormat(format);
+    surface.create();
+    context.setFormat(format);
+    if (!surface.isValid() || !context.create() || !context.makeCurrent(&surface)) {
+        if (errorMessage)
+            *errorMessage = "Could not create an offscreen OpenGL context";
+        return false;
+    }
+    renderer.initialize();
+    context.extraFunctions()->glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+    // A stale socket file left by a crashed server would make listen() fail.
+    QLocalServer::removeServer(name);
+    server.setSocketOptions(QLocalServer::UserAccessOption);
+    if (!server.listen(name)) {
+        if (errorMessage)
+            *errorMessage = server.errorString();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Accepts pending connections.
+ */
+void RenderServer::onNewConnection()
+{
+    while (QLocalSocket *socket = server.nextPendingConnection()) {
+        clients.insert(socket, Client());
+        connect(socket, &QLocalSocket::readyRead, this, &RenderServer::onReadyRead);
+        connect(socket, &QLocalSocket::disconnected, this, &RenderServer::onDisconnected);
+    }
+}
+
+/**
+ * @brief Forgets a disconnected client and unmaps its shared memory.
+ */
+void RenderServer::onDisconnected()
+{
+    QLocalSocket *socket = qobject_cast<QLocalSocket *>(sender());
+    auto it = clients.find(socket);
+    if (it == clients.end())
+        return;
+    detachMemory(it.value());
+    clients.erase(it);
+    socket->deleteLater();
+}
+
+/**
+ * @brief Executes every complete batch received from a client and sends the replies.
+ *
+ * Incomplete batches stay buffered until the rest arrives. The replies of all batches
+ * handled in one call are written with a single socket write, also when a malformed batch
+ * then closes the connection.
+ */
+void RenderServer::onReadyRead()
+{
+    QLocalSocket *socket = qobject_cast<QLocalSocket *>(sender());
+    auto it = clients.find(socket);
+    if (it == clients.end())
+        return;
+    Client &client = it.value();
+    client.pending.append(socket->readAll());
+
+    reply.clear();
+    qsizetype consumed = 0;
+    while (client.pending.size() - consumed >= qsizetype(sizeof(BatchHeader))) {
+        BatchHeader header;
+        std::memcpy(&header, client.pending.constData() + consumed, sizeof(header));
+        if (header.magic != Magic || header.version != Version || header.payloadBytes > MaxBatchBytes) {
+            qWarning() << "Render server: closing connection after a malformed batch";
+            client.pending.clear();
+            // The batches before it have rendered into shared memory; the client still gets
+            // their replies, which disconnectFromServer() sends before closing.
+            if (!reply.isEmpty())
+                socket->write(reply);
+            socket->disconnectFromServer(); // may emit disconnected() and erase the client
+            return;
+        }
+        const qsizetype batchBytes = qsizetype(sizeof(header)) + header.payloadBytes;
+        if (client.pending.size() - consumed < batchBytes)
+            break;
+        executeBatch(client, client.pending.constData() + consumed + sizeof(header), header);
+        consumed += batchBytes;
+    }
+    client.pending.remove(0, consumed);
+    if (!reply.isEmpty())
+        socket->write(reply);
+}
+
+/**
+ * @brief Runs the commands of one batch and appends its reply.
+ * @param client The client that sent the batch.
+ * @param commands The batch payload (header.payloadBytes bytes).
+ * @param header The batch header.
+ *
+ * A malformed command stops the batch; other failures are reported in the reply and the
+ * remaining commands still run.
+ */
+void RenderServer::executeBatch(Client &client, const char *commands, const BatchHeader &header)
+{
+    const qsizetype replyStart = reply.size();
+    ReplyHeader replyHeader {Magic, Ok, 0, 0};
+    reply.append(reinterpret_cast<const char *>(&replyHeader), sizeof(replyHeader));
+
+    quint32 offset = 0;
+    for (quint32 i = 0; i < header.commandCount; ++i) {
+        CommandHeader command;
+        quint32 status = BadCommand;
+        if (header.payloadBytes - offset >= sizeof(command)) {
+            std::memcpy(&command, commands + offset, sizeof(command));
+            offset += sizeof(command);
+            if (command.size <= header.payloadBytes - offset)
+                status = Ok;
+        }
+        const char *payload = commands + offset;
+        if (status == Ok) {
+            offset += command.size;
+            switch (command.opcode) {
+            case AttachMemory:
+                status = attachMemory(client, payload, command.size);
+                break;
+            case RotateAboutLine: {
+                RotatePayload rotate;
+                if (command.size != sizeof(rotate)) {
+                    status = BadCommand;
+                    break;
+                }
+                std::memcpy(&rotate, payload, sizeof(rotate));
+                const int cube = rotate.cube < 0 ? cubeScene.selectedIndex() : rotate.cube;
+                if (cube >= cubeScene.cubeCount()) {
+                    status = BadCommand;
+                    break;
+                }
+                cubeScene.rotateAboutLine(cube, QVector3D(rotate.b[0], rotate.b[1], rotate.b[2]),
+                                          QVector3D(rotate.d[0], rotate.d[1], rotate.d[2]), rotate.angle);
+                break;
+            }
+            case SetView: {
+                ViewPayload view;
+                if (command.size != sizeof(view)) {
+                    status = BadCommand;
+                    break;
+                }
+                std::memcpy(&view, payload, sizeof(view));
+                cubeScene.setViewPosition(QVector3D(view.eye[0], view.eye[1], view.eye[2]),
+                                          QVector3D(view.center[0], view.center[1], view.center[2]));
+                break;
+            }
+            case ToggleGloss:
+                cubeScene.toggleGloss();
+                break;
+            case RenderImage: {
+                RenderPayload request;
+                if (command.size != sizeof(request)) {
+                    status = BadCommand;
+                    break;
+                }
+                std::memcpy(&request, payload, sizeof(request));
+                status = renderImage(client, request);
+                const RenderResult result {status, request.width, request.height, i, request.offset,
+                                           quint64(request.width) * request.height * 4};
+                reply.append(reinterpret_cast<const char *>(&result), sizeof(result));
+                ++replyHeader.resultCount;
+                break;
+            }
+            default:
+                status = BadCommand;
+                break;
+            }
+        }
+        if (status != Ok && replyHeader.status == Ok)
+            replyHeader.status = status;
+        if (status == BadCommand)
+            break;
+        ++replyHeader.executed;
+    }
+
+    // Every image of the batch must be in shared memory before the reply goes out.
+    finishReadbacks();
+    for (quint32 r = 0; r < replyHeader.resultCount && replyHeader.status == Ok; ++r) {
+        RenderResult result;
+        std::memcpy(&result, reply.constData() + replyStart + sizeof(replyHeader) + r * sizeof(result),
+                    sizeof(result));
+        replyHeader.status = result.status;
+    }
+    std::memcpy(reply.data() + replyStart, &replyHeader, sizeof(replyHeader));
+}
+
+/**
+ * @brief Maps the client's POSIX shared memory object, replacing any previous mapping.
+ * @param payload quint64 size followed by the object name (e.g. "/cube-frames").
+ * @param size Payload size in bytes.
+ */
+quint32 RenderServer::attachMemory(Client &client, const char *payload, quint32 size)
+{
+    quint64 bytes = 0;
+    if (size <= sizeof(bytes))
+        return BadCommand;
+    std::memcpy(&bytes, payload, sizeof(bytes));
+    const QByteArray name(payload + sizeof(bytes), size - sizeof(bytes));
+    finishReadbacks(); // earlier renders of the batch may still target the old mapping
+    detachMemory(client);
+#ifdef Q_OS_UNIX
+    const int fd = shm_open(name.constData(), O_RDWR, 0);
+    if (fd < 0)
+        return AttachFailed;
+    struct stat info;
+    void *mapping = MAP_FAILED;
+    if (bytes > 0 && fstat(fd, &info) == 0 && quint64(info.st_size) >= bytes)
+        mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+        return AttachFailed;
+    client.memory = static_cast<uchar *>(mapping);
+    client.memorySize = bytes;
+    return Ok;
+#else
+    Q_UNUSED(name);
+    return Unsupported;
+#endif
+}
+
+/**
+ * @brief Unmaps the client's shared memory, if any.
+ */
+void RenderServer::detachMemory(Client &client)
+{
+#ifdef Q_OS_UNIX
+    if (client.memory)
+        munmap(client.memory, client.memorySize);
+#endif
+    client.memory = nullptr;
+    client.memorySize = 0;
+}
+
+/**
+ * @brief (Re)creates the offscreen framebuffer when the requested size changes.
+ *
+ * Batches that render many images of one size reuse the same framebuffer. A framebuffer
+ * that could not be created is not kept, so the next request of that size tries again.
+ */
+bool RenderServer::ensureTarget(int width, int height)
+{
+    if (target && target->width() == width && target->height() == height)
+        return true;
+    delete target;
+    target = new QOpenGLFramebufferObject(width, height, QOpenGLFramebufferObject::Depth);
+    if (!target->isValid()) {
+        delete target;
+        target = nullptr;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Waits for a readback to finish and copies the image into shared memory.
+ *
+ * If the buffer cannot be mapped, the render's result in the reply is changed to
+ * RenderFailed.
+ */
+void RenderServer::completeReadback(Readback &readback)
+{
+    if (!readback.fence)
+        return;
+    QOpenGLExtraFunctions *gl = context.extraFunctions();
+    gl->glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+    gl->glDeleteSync(readback.fence);
+    readback.fence = nullptr;
+    gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+    const void *pixels = gl->glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, readback.bytes, GL_MAP_READ_BIT);
+    if (pixels) {
+        std::memcpy(readback.destination, pixels, size_t(readback.bytes));
+        gl->glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    } else {
+        const quint32 status = RenderFailed;
+        std::memcpy(reply.data() + readback.resultOffset + offsetof(RenderResult, status), &status,
+                    sizeof(status));
+    }
+    gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+/**
+ * @brief Completes every readback in flight, oldest first.
+ */
+void RenderServer::finishReadbacks()
+{
+    for (int i = 0; i < ReadbackSlots; ++i)
+        completeReadback(readbacks[(nextReadback + i) % ReadbackSlots]);
+}
+
+/**
+ * @brief Renders the scene offscreen and starts reading the image back.
+ * @return A RenderProtocol::Status.
+ *
+ * The pixels are read into one of ReadbackSlots pixel pack buffers guarded by a fence, so
+ * the next renders of the batch are issued while earlier images are still being copied;
+ * the CPU only waits when it reuses a slot or finishes the batch. The caller appends the
+ * render's RenderResult to the reply right after this returns.
+ */
+quint32 RenderServer::renderImage(Client &client, const RenderPayload &request)
+{
+    if (!client.memory)
+        return NoMemory;
+    if (request.width == 0 || request.height == 0
+        || request.width > MaxImageSize || request.height > MaxImageSize)
+        return BadCommand;
+    const quint64 bytes = quint64(request.width) * request.height * 4;
+    if (request.offset > client.memorySize || bytes > client.memorySize - request.offset)
+        return OutOfBounds;
+
+    const int width = int(request.width);
+    const int height = int(request.height);
+    if (QOpenGLContext::currentContext() != &context && !context.makeCurrent(&surface))
+        return RenderFailed;
+    if (!ensureTarget(width, height))
+        return RenderFailed;
+    target->bind();
+    renderer.resize(width, height);
+    renderer.render(cubeScene);
+
+    QOpenGLExtraFunctions *gl = context.extraFunctions();
+    Readback &readback = readbacks[nextReadback];
+    nextReadback = (nextReadback + 1) % ReadbackSlots;
+    completeReadback(readback);
+    if (!readback.buffer)
+        gl->glGenBuffers(1, &readback.buffer);
+    gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+    if (readback.capacity < qint64(bytes)) {
+        gl->glBufferData(GL_PIXEL_PACK_BUFFER, GLsizeiptr(bytes), nullptr, GL_STREAM_READ);
+        readback.capacity = qint64(bytes);
+    }
+    gl->glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    gl->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    readback.fence = gl->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    readback.destination = client.memory + request.offset;
+    readback.bytes = qint64(bytes);
+    readback.resultOffset = reply.size();
+    return Ok;
+}
@@ -0,0 +1,174 @@
+#ifndef RENDERSERVER_H
+#define RENDERSERVER_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QLocalServer>
+#include <QObject>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QString>
+#include <QtGlobal>
+#include "cuberenderer.h"
+#include "cubescene.h"
+
+class QLocalSocket;
+class QOpenGLFramebufferObject;
+
+/**
+ * @brief Wire format of the render server. All values are little-endian.
+ *
+ * A client sends batches: a BatchHeader followed by commandCount commands, each a
+ * CommandHeader and its payload, payloadBytes in total. The server executes the commands in
+ * order and answers every batch with a ReplyHeader followed by one RenderResult per
+ * RenderImage command. Images are never sent over the socket: the client creates a POSIX
+ * shared memory object, attaches it with AttachMemory, and each image is copied into it at
+ * the requested offset (RGBA8, tightly packed, bottom row first). All images of a batch are
+ * in place when its reply is sent.
+ */
+namespace RenderProtocol {
+
+constexpr quint32 Magic = 0x42535243; ///< "CRSB" in a little-endian stream.
+constexpr quint32 Version = 1;
+constexpr quint32 MaxBatchBytes = 16 * 1024 * 1024;
+constexpr quint32 MaxImageSize = 8192;
+
+enum Opcode : quint16 {
+    AttachMemory = 1,    ///< payload: quint64 size, then the shared memory object name (UTF-8)
+    RotateAboutLine = 2, ///< payload: RotatePayload
+    SetView = 3,         ///< payload: ViewPayload
+    ToggleGloss = 4,     ///< no payload
+    RenderImage = 5      ///< payload: RenderPayload
+};
+
+enum Status : quint32 {
+    Ok = 0,
+    BadCommand = 1,      ///< Unknown opcode or malformed payload; the rest of the batch is skipped.
+    NoMemory = 2,        ///< RenderImage without attached shared memory.
+    OutOfBounds = 3,     ///< The image does not fit in the shared memory at that offset.
+    AttachFailed = 4,    ///< The shared memory object could not be opened or mapped.
+    Unsupported = 5,     ///< Shared memory is not available on this platform.
+    RenderFailed = 6     ///< The offscreen framebuffer could not be created.
+};
+
+struct BatchHeader
+{
+    quint32 magic;
+    quint32 version;
+    quint32 commandCount;
+    quint32 payloadBytes; ///< Bytes of commands following the header.
+};
+
+struct CommandHeader
+{
+    quint16 opcode;
+    quint16 reserved;
+    quint32 size;         ///< Bytes of payload following the command header.
+};
+
+struct RotatePayload
+{
+    qint32 cube;          ///< Cube index, or -1 for the selected cube.
+    float b[3];           ///< Point on the line.
+    float d[3];           ///< Line direction.
+    float angle;          ///< Degrees.
+};
+
+struct ViewPayload
+{
+    float eye[3];
+    float center[3];
+};
+
+struct RenderPayload
+{
+    quint32 width;
+    quint32 height;
+    quint64 offset;       ///< Byte offset of the image in the shared memory.
+};
+
+struct ReplyHeader
+{
+    quint32 magic;
+    quint32 status;       ///< First non-Ok status of the batch, or Ok.
+    quint32 resultCount;
+    quint32 executed;     ///< Number of commands executed.
+};
+
+struct RenderResult
+{
+    quint32 status;
+    quint32 width;
+    quint32 height;
+    quint32 command;      ///< Index of the RenderImage command within the batch.
+    quint64 offset;
+    quint64 bytes;
+};
+
+static_assert(sizeof(BatchHeader) == 16, "unexpected batch header size");
+static_assert(sizeof(CommandHeader) == 8, "unexpected command header size");
+static_assert(sizeof(RotatePayload) == 32, "unexpected rotate payload size");
+static_assert(sizeof(ViewPayload) == 24, "unexpected view payload size");
+static_assert(sizeof(RenderPayload) == 16, "unexpected render payload size");
+static_assert(sizeof(ReplyHeader) == 16, "unexpected reply header size");
+static_assert(sizeof(RenderResult) == 32, "unexpected render result size");
+
+} // namespace RenderProtocol
+
+class RenderServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit RenderServer(QObject *parent = nullptr);
+    ~RenderServer();
+
+    bool start(const QString &name, QString *errorMessage = nullptr);
+    CubeScene &scene() { return cubeScene; }
+
+private slots:
+    void onNewConnection();
+    void onReadyRead();
+    void onDisconnected();
+
+private:
+    struct Client
+    {
+        QByteArray pending;
+        uchar *memory = nullptr;
+        quint64 memorySize = 0;
+    };
+
+    /// A glReadPixels into a pixel pack buffer that is copied to shared memory later.
+    struct Readback
+    {
+        GLuint buffer = 0;
+        qint64 capacity = 0;
+        GLsync fence = nullptr;       ///< Set while the readback is in flight.
+        uchar *destination = nullptr;
+        qint64 bytes = 0;
+        qsizetype resultOffset = 0;   ///< Position of its RenderResult in reply.
+    };
+
+    static constexpr int ReadbackSlots = 3;
+
+    void executeBatch(Client &client, const char *commands, const RenderProtocol::BatchHeader &header);
+    quint32 attachMemory(Client &client, const char *payload, quint32 size);
+    void detachMemory(Client &client);
+    quint32 renderImage(Client &client, const RenderProtocol::RenderPayload &request);
+    bool ensureTarget(int width, int height);
+    void completeReadback(Readback &readback);
+    void finishReadbacks();
+
+    QLocalServer server;
+    QOffscreenSurface surface;
+    QOpenGLContext context;
+    QOpenGLFramebufferObject *target;
+    CubeScene cubeScene;
+    CubeRenderer renderer;
+    QHash<QLocalSocket *, Client> clients;
+    QByteArray reply;
+    Readback readbacks[ReadbackSlots];
+    int nextReadback;
+};
+
+#endif // RENDERSERVER_H
@@ -0,0 +1,332 @@
+/**
+ * @file scenefile.cpp
+ * @brief Reading and writing the binary scene format.
+ *
+ * A scene file is a small header, a fixed-capacity section directory and a sequence of
+ * sections. Every section is an array of fixed-size records whose layout is identical to the
+ * in-memory (and GPU buffer) layout, aligned to SectionAlignment bytes:
+ * - Settings: camera eye/target/distance, gloss toggle and directional light.
+ * - Transforms: one CubeTransform per cube, uploaded as-is to the instance buffer.
+ * - TexturePhases: one quint32 texture phase offset per cube.
+ * - Lights: one Light per clustered light, uploaded as-is to the light texture.
+ * - Animations (optional): one CubeAnimation per cube, uploaded as-is to the animation buffer.
+ *
+ * Files are little-endian. Readers ignore sections with unknown tags, so later versions can add
+ * sections without breaking older builds; a changed record layout requires a new version.
+ *
+ * MappedScene memory-maps the file and hands out pointers straight into the mapping, so loading
+ * involves no per-object parsing. SceneWriter streams sections to disk and fills in the
+ * directory when it is closed, so large scenes can be written in chunks. It writes to a
+ * temporary file that replaces the target only if every write succeeded, so a failed save
+ * never leaves a truncated file behind a valid-looking header.
+ */
+
+#include "scenefile.h"
+#include "cubeinstance.h"
+#include "lightcluster.h"
+#include <cstring>
+
+using namespace SceneFormat;
+
+namespace {
+constexpr qint64 kDirectoryOffset = sizeof(Header);
+
+/**
+ * @brief Returns the record size a reader of this version expects for a tag, or 0 for tags
+ * this version does not know.
+ */
+quint32 expectedStride(quint32 tag)
+{
+    switch (tag) {
+    case Settings: return sizeof(SceneSettings);
+    case Transforms: return sizeof(CubeTransform);
+    case TexturePhases: return sizeof(quint32);
+    case Lights: return sizeof(Light);
+    case Animations: return sizeof(CubeAnimation);
+    default: return 0;
+    }
+}
+}
+
+/**
+ * @brief Constructs a writer for the given path. Nothing is written until open().
+ */
+SceneWriter::SceneWriter(const QString &path)
+    : file(path),
+      inSection(false),
+      failed(false)
+{
+}
+
+/**
+ * @brief Destroys the writer, finalizing the file if close() was not called (and nothing
+ * failed; otherwise the target file is left as it was).
+ */
+SceneWriter::~SceneWriter()
+{
+    if (file.isOpen())
+        close();
+}
+
+bool SceneWriter::fail(const QString &message)
+{
+    error = message;
+    failed = true;
+    return false;
+}
+
+/**
+ * @brief Pads the file with zeros up to the next section boundary.
+ */
+bool SceneWriter::pad()
+{
+    static const char zeros[SectionAlignment] = {};
+    const qint64 misalignment = file.pos() % SectionAlignment;
+    if (misalignment == 0)
+        return true;
+    const qint64 padding = SectionAlignment - misalignment;
+    return file.write(zeros, padding) == padding;
+}
+
+/**
+ * @brief Creates the file and reserves space for the header and section directory.
+ * @return true on success; see errorString() otherwise.
+ */
+bool SceneWriter::open()
+{
+    failed = false;
+    if (!file.open(QIODevice::WriteOnly))
+        return fail(file.errorString());
+    sections.clear();
+    inSection = false;
+    QByteArray reserved(kDirectoryOffset + DirectoryCapacity * sizeof(SectionEntry), '\0');
+    if (file.write(reserved) != reserved.size() || !pad())
+        return fail(file.errorString());
+    return true;
+}
+
+/**
+ * @brief Starts a new section; records are then added with append().
+ * @param tag One of SceneFormat::SectionTag.
+ * @param stride Size in bytes of one record.
+ */
+bool SceneWriter::beginSection(quint32 tag, quint32 stride)
+{
+    if (!file.isOpen() || inSection)
+        return fail("Scene writer is not ready for a new section");
+    if (sections.size() >= int(DirectoryCapacity))
+        return fail("Too many sections in scene file");
+    if (!pad())
+        return fail(file.errorString());
+    sections.append({tag, stride, quint64(file.pos()), 0});
+    inSection = true;
+    return true;
+}
+
+/**
+ * @brief Appends records to the current section.
+ * @param elements Pointer to count records of the section's stride.
+ * @param count Number of records.
+ */
+bool SceneWriter::append(const void *elements, qint64 count)
+{
+    if (!inSection)
+        return fail("No open section");
+    SectionEntry &entry = sections.last();
+    const qint64 bytes = count * entry.stride;
+    if (file.write(static_cast<const char *>(elements), bytes) != bytes)
+        return fail(file.errorString());
+    entry.count += quint64(count);
+    return true;
+}
+
+/**
+ * @brief Ends the current section.
+ */
+bool SceneWriter::endSection()
+{
+    if (!inSection)
+        return fail("No open section");
+    inSection = false;
+    return true;
+}
+
+/**
+ * @brief Convenience for writing a whole section from one contiguous array.
+ */
+bool SceneWriter::writeSection(quint32 tag, quint32 stride, const void *elements, qint64 count)
+{
+    return beginSection(tag, stride) && append(elements, count) && endSection();
+}
+
+/**
+ * @brief Writes the header and section directory and replaces the target file with the
+ * result.
+ * @return false if this or any earlier step failed; the target file is then unchanged.
+ */
+bool SceneWriter::close()
+{
+    if (!file.isOpen())
+        return fail("Scene file is not open");
+    if (inSection)
+        endSection();
+    if (!failed) {
+        const Header header {Magic, Version, quint32(sections.size()), DirectoryCapacity};
+        const qint64 directoryBytes = sections.size() * qint64(sizeof(SectionEntry));
+        const bool ok = file.seek(0)
+                && file.write(reinterpret_cast<const char *>(&header), sizeof(header)) == qint64(sizeof(header))
+                && file.write(reinterpret_cast<const char *>(sections.constData()), directoryBytes) == directoryBytes;
+        if (!ok)
+            fail(file.errorString());
+    }
+    if (failed) {
+        file.cancelWriting();
+        file.commit(); // discards the temporary file
+        return false;
+    }
+    if (!file.commit())
+        return fail(file.errorString());
+    return true;
+}
+
+/**
+ * @brief Constructs an empty (unmapped) scene.
+ */
+MappedScene::MappedScene()
+    : data(nullptr),
+      size(0)
+{
+}
+
+/**
+ * @brief Unmaps the file, invalidating all pointers handed out.
+ */
+MappedScene::~MappedScene()
+{
+    close();
+}
+
+bool MappedScene::fail(const QString &message)
+{
+    error = message;
+    close();
+    return false;
+}
+
+/**
+ * @brief Maps a scene file and validates its header and section directory.
+ * @param path Path of the scene file.
+ * @return true on success; see errorString() otherwise.
+ *
+ * Only the header and directory are read; the section payloads are left untouched in the
+ * mapping until the caller uses them.
+ */
+bool MappedScene::open(const QString &path)
+{
+    close();
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return fail(file.errorString());
+    size = file.size();
+    if (size < qint64(sizeof(Header)))
+        return fail("File is too small to be a scene");
+    data = file.map(0, size);
+    if (!data)
+        return fail(file.errorString());
+
+    Header header;
+    std::memcpy(&header, data, sizeof(header));
+    if (header.magic != Magic)
+        return fail("Not a scene file");
+    if (header.version != Version)
+        return fail(QString("Unsupported scene version %1").arg(header.version));
+    if (header.sectionCount > header.directoryCapacity
+        || kDirectoryOffset + qint64(header.directoryCapacity) * qint64(sizeof(SectionEntry)) > size)
+        return fail("Corrupt scene directory");
+
+    sections.resize(header.sectionCount);
+    std::memcpy(sections.data(), data + kDirectoryOffset, header.sectionCount * sizeof(SectionEntry));
+    for (const SectionEntry &entry : std::as_const(sections)) {
+        if (entry.offset % SectionAlignment != 0 || entry.offset > quint64(size)
+            || (entry.stride != 0 && entry.count > (quint64(size) - entry.offset) / entry.stride))
+            return fail("Scene section exceeds the file");
+        const quint32 stride = expectedStride(entry.tag);
+        if (stride != 0 && entry.stride != stride)
+            return fail(QString("Scene section %1 has an unexpected record size").arg(entry.tag));
+    }
+    return true;
+}
+
+/**
+ * @brief Unmaps and closes the file.
+ */
+void MappedScene::close()
+{
+    if (data)
+        file.unmap(data);
+    data = nullptr;
+    size = 0;
+    sections.clear();
+    if (file.isOpen())
+        file.close();
+}
+
+/**
+ * @brief Finds a section in the mapping.
+ * @return Pointer to its first record, or nullptr (and a count of 0) if it is missing.
+ */
+const uchar *MappedScene::section(quint32 tag, quint32 stride, qint64 *count) const
+{
+    for (const SectionEntry &entry : sections) {
+        if (entry.tag == tag && entry.stride == stride) {
+            if (count)
+                *count = qint64(entry.count);
+            return data + entry.offset;
+        }
+    }
+    if (count)
+        *count = 0;
+    return nullptr;
+}
+
+/**
+ * @brief Returns the scene settings, or nullptr if the file has none.
+ */
+const SceneSettings *MappedScene::settings() const
+{
+    qint64 count = 0;
+    const uchar *p = section(Settings, sizeof(SceneSettings), &count);
+    return count > 0 ? reinterpret_cast<const SceneSettings *>(p) : nullptr;
+}
+
+/**
+ * @brief Returns the cube transforms stored in the mapping.
+ */
+const CubeTransform *MappedScene::transforms(qint64 *count) const
+{
+    return reinterpret_cast<const CubeTransform *>(section(Transforms, sizeof(CubeTransform), count));
+}
+
+/**
+ * @brief Returns the per-cube texture phase offsets stored in the mapping.
+ */
+const quint32 *MappedScene::texturePhases(qint64 *count) const
+{
+    return reinterpret_cast<const quint32 *>(section(TexturePhases, sizeof(quint32), count));
+}
+
+/**
+ * @brief Returns the clustered lights stored in the mapping.
+ */
+const Light *MappedScene::lights(qint64 *count) const
+{
+    return reinterpret_cast<const Light *>(section(Lights, sizeof(Light), count));
+}
+
+/**
+ * @brief Returns the per-cube animations stored in the mapping, if any.
+ */
+const CubeAnimation *MappedScene::animations(qint64 *count) const
+{
+    return reinterpret_cast<const CubeAnimation *>(section(Animations, sizeof(CubeAnimation), count));
+}
@@ -0,0 +1,116 @@
+#ifndef SCENEFILE_H
+#define SCENEFILE_H
+
+#include <QFile>
+#include <QList>
+#include <QSaveFile>
+#include <QString>
+#include <QtGlobal>
+
+struct CubeTransform;
+struct CubeAnimation;
+struct Light;
+
+namespace SceneFormat {
+
+constexpr quint32 Magic = 0x53425543; ///< "CUBS" in a little-endian file.
+constexpr quint32 Version = 1;
+constexpr quint32 DirectoryCapacity = 8;
+constexpr qint64 SectionAlignment = 64;
+
+enum SectionTag : quint32 {
+    Settings = 1,      ///< One SceneSettings record.
+    Transforms = 2,    ///< CubeTransform per cube.
+    TexturePhases = 3, ///< quint32 texture phase offset per cube.
+    Lights = 4,        ///< Light per clustered light.
+    Animations = 5     ///< CubeAnimation per cube (optional).
+};
+
+struct Header
+{
+    quint32 magic;
+    quint32 version;
+    quint32 sectionCount;
+    quint32 directoryCapacity;
+};
+
+struct SectionEntry
+{
+    quint32 tag;
+    quint32 stride; ///< Size of one element; checked against the reader's struct size.
+    quint64 offset; ///< Byte offset from the start of the file, SectionAlignment aligned.
+    quint64 count;
+};
+
+struct SceneSettings
+{
+    float eye[3];
+    float cameraDistance;
+    float target[3];
+    quint32 glossEnabled;
+    float lightDirection[3];
+    quint32 reserved;
+};
+
+static_assert(sizeof(Header) == 16, "unexpected scene header size");
+static_assert(sizeof(SectionEntry) == 24, "unexpected scene section entry size");
+static_assert(sizeof(SceneSettings) == 48, "unexpected scene settings size");
+
+} // namespace SceneFormat
+
+class SceneWriter
+{
+public:
+    explicit SceneWriter(const QString &path);
+    ~SceneWriter();
+
+    bool open();
+    bool beginSection(quint32 tag, quint32 stride);
+    bool append(const void *elements, qint64 count);
+    bool endSection();
+    bool close();
+
+    bool writeSection(quint32 tag, quint32 stride, const void *elements, qint64 count);
+
+    QString errorString() const { return error; }
+
+private:
+    bool fail(const QString &message);
+    bool pad();
+
+    QSaveFile file;
+    QList<SceneFormat::SectionEntry> sections;
+    bool inSection;
+    bool failed; ///< A write failed; close() then leaves the target file untouched.
+    QString error;
+};
+
+class MappedScene
+{
+public:
+    MappedScene();
+    ~MappedScene();
+
+    bool open(const QString &path);
+    void close();
+
+    const SceneFormat::SceneSettings *settings() const;
+    const CubeTransform *transforms(qint64 *count) const;
+    const quint32 *texturePhases(qint64 *count) const;
+    const Light *lights(qint64 *count) const;
+    const CubeAnimation *animations(qint64 *count) const;
+
+    QString errorString() const { return error; }
+
+private:
+    const uchar *section(quint32 tag, quint32 stride, qint64 *count) const;
+    bool fail(const QString &message);
+
+    QFile file;
+    uchar *data;
+    qint64 size;
+    QList<SceneFormat::SectionEntry> sections;
+    QString error;
+};
+
+#endif // SCENEFILE_H
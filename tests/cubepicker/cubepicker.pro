@@ -0,0 +1,17 @@
+QT = core gui testlib
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+TARGET = tst_cubepicker
+TEMPLATE = app
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    ../../cubepicker.cpp \
+    tst_cubepicker.cpp
+
+HEADERS += \
+    ../../cubeinstance.h \
+    ../../cubepicker.h
@@ -0,0 +1,213 @@
+/**
+ * @file tst_cubepicker.cpp
+ * @brief Compares BVH picking against testing every cube.
+ */
+
+#include "cubepicker.h"
+#include <QRandomGenerator>
+#include <QtTest>
+#include <cmath>
+#include <limits>
+
+class TestCubePicker : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void matchesBruteForce();
+    void matchesBruteForceAfterEdits();
+    void matchesBruteForceWhileAnimated();
+    void axisAlignedRays();
+    void emptyScene();
+};
+
+namespace {
+constexpr float kInfinity = std::numeric_limits<float>::infinity();
+
+/**
+ * @brief Reference picker: slab test of the ray against every oriented cube.
+ */
+int bruteForcePick(const QList<CubeTransform> &transforms, const QVector3D &origin,
+                   const QVector3D &direction, float *distance)
+{
+    int best = -1;
+    float bestT = kInfinity;
+    for (int i = 0; i < transforms.size(); ++i) {
+        const CubeTransform &t = transforms.at(i);
+        const QQuaternion inverse = t.rotation().conjugated();
+        const QVector3D o = inverse.rotatedVector(origin - t.translation());
+        const QVector3D d = inverse.rotatedVector(direction);
+        const float half = 0.5f * t.scale;
+        float t0 = 0.0f;
+        float t1 = kInfinity;
+        bool hit = true;
+        for (int a = 0; a < 3 && hit; ++a) {
+            if (std::fabs(d[a]) < 1e-8f) {
+                hit = o[a] >= -half && o[a] <= half;
+                continue;
+            }
+            const float tA = (-half - o[a]) / d[a];
+            const float tB = (half - o[a]) / d[a];
+            t0 = std::max(t0, std::min(tA, tB));
+            t1 = std::min(t1, std::max(tA, tB));
+            hit = t0 <= t1;
+        }
+        if (hit && t0 < bestT) {
+            bestT = t0;
+            best = i;
+        }
+    }
+    *distance = bestT;
+    return best;
+}
+
+float uniform(QRandomGenerator &random, float low, float high)
+{
+    return low + float(random.generateDouble()) * (high - low);
+}
+
+QVector3D randomVector(QRandomGenerator &random, float extent)
+{
+    return QVector3D(uniform(random, -extent, extent), uniform(random, -extent, extent),
+                     uniform(random, -extent, extent));
+}
+
+CubeTransform randomCube(QRandomGenerator &random)
+{
+    CubeTransform t = CubeTransform::identity();
+    t.setTranslation(randomVector(random, 20.0f));
+    t.scale = uniform(random, 0.2f, 1.5f);
+    t.setRotation(QQuaternion::fromAxisAndAngle(randomVector(random, 1.0f) + QVector3D(0, 0, 0.01f),
+                                                uniform(random, -180.0f, 180.0f)));
+    return t;
+}
+
+QList<CubeTransform> randomCubes(QRandomGenerator &random, int count)
+{
+    QList<CubeTransform> transforms;
+    for (int i = 0; i < count; ++i)
+        transforms.append(randomCube(random));
+    return transforms;
+}
+
+/**
+ * @brief Picks rays aimed into the scene with both pickers; equal distances count as a
+ * match, since touching cubes may tie.
+ */
+void comparePicks(CubePicker &picker, const QList<CubeTransform> &transforms,
+                  QRandomGenerator &random, int rays)
+{
+    int hits = 0;
+    for (int r = 0; r < rays; ++r) {
+        const QVector3D origin = randomVector(random, 40.0f);
+        const QVector3D direction = (randomVector(random, 15.0f) - origin).normalized();
+        float distance, expectedDistance;
+        const int picked = picker.pick(transforms, origin, direction, &distance);
+        const int expected = bruteForcePick(transforms, origin, direction, &expectedDistance);
+        if (picked != expected)
+            QVERIFY2(std::fabs(distance - expectedDistance) < 1e-4f,
+                     qPrintable(QString("ray %1 picked %2, expected %3").arg(r).arg(picked).arg(expected)));
+        hits += expected >= 0;
+    }
+    QVERIFY(hits > 0);
+}
+}
+
+void TestCubePicker::matchesBruteForce()
+{
+    QRandomGenerator random(1);
+    const QList<CubeTransform> transforms = randomCubes(random, 2000);
+    CubePicker picker;
+    comparePicks(picker, transforms, random, 2000);
+    QVERIFY(picker.nodeCount() > 1);
+}
+
+void TestCubePicker::matchesBruteForceAfterEdits()
+{
+    QRandomGenerator random(2);
+    QList<CubeTransform> transforms = randomCubes(random, 1000);
+    CubePicker picker;
+    comparePicks(picker, transforms, random, 200);
+
+    // A few moved cubes refit their leaves; moving most of them refits the whole tree.
+    for (int i = 10; i < 15; ++i)
+        transforms[i] = randomCube(random);
+    picker.invalidate(10, 15);
+    comparePicks(picker, transforms, random, 500);
+
+    for (int i = 0; i < 900; ++i)
+        transforms[i] = randomCube(random);
+    picker.invalidate(0, 900);
+    comparePicks(picker, transforms, random, 500);
+
+    transforms.append(randomCube(random)); // a new cube count rebuilds the tree
+    comparePicks(picker, transforms, random, 500);
+}
+
+void TestCubePicker::matchesBruteForceWhileAnimated()
+{
+    QRandomGenerator random(3);
+    const QList<CubeTransform> transforms = randomCubes(random, 1500);
+    QList<CubeAnimation> animations;
+    for (int i = 0; i < transforms.size(); ++i) {
+        switch (i % 3) {
+        case 0:
+            animations.append(CubeAnimation::none());
+            break;
+        case 1:
+            animations.append(CubeAnimation::spin(randomVector(random, 1.0f) + QVector3D(0, 0.01f, 0),
+                                                  uniform(random, -5.0f, 5.0f)));
+            break;
+        default:
+            animations.append(CubeAnimation::aboutLine(randomVector(random, 10.0f),
+                                                       randomVector(random, 1.0f) + QVector3D(0.01f, 0, 0),
+                                                       uniform(random, -3.0f, 3.0f)));
+            break;
+        }
+    }
+
+    // The swept bounds are fitted once; every time must still find the posed cube.
+    CubePicker picker;
+    for (qint64 ticks : {qint64(0), qint64(17), qint64(1000), qint64(123456789)}) {
+        QList<CubeTransform> posed;
+        for (int i = 0; i < transforms.size(); ++i)
+            posed.append(animations.at(i).at(transforms.at(i), ticks));
+        for (int r = 0; r < 500; ++r) {
+            const QVector3D origin = randomVector(random, 40.0f);
+            const QVector3D direction = (randomVector(random, 15.0f) - origin).normalized();
+            float distance, expectedDistance;
+            const int picked = picker.pick(transforms, animations, ticks, origin, direction, &distance);
+            const int expected = bruteForcePick(posed, origin, direction, &expectedDistance);
+            if (picked != expected)
+                QVERIFY(std::fabs(distance - expectedDistance) < 1e-4f);
+        }
+    }
+}
+
+void TestCubePicker::axisAlignedRays()
+{
+    // Rays parallel to an axis, starting on the bounds' planes, must not produce NaN slabs.
+    QList<CubeTransform> transforms;
+    for (int i = 0; i < 64; ++i) {
+        CubeTransform t = CubeTransform::identity();
+        t.setTranslation(QVector3D(float(i % 4), float((i / 4) % 4), float(i / 16)));
+        transforms.append(t);
+    }
+    CubePicker picker;
+    float distance;
+    QCOMPARE(picker.pick(transforms, QVector3D(-0.5f, 0.0f, -5.0f), QVector3D(0, 0, 1), &distance), 0);
+    QCOMPARE(distance, 4.5f);
+    QCOMPARE(picker.pick(transforms, QVector3D(3.0f, 3.0f, 10.0f), QVector3D(0, 0, -1), &distance), 63);
+    QCOMPARE(picker.pick(transforms, QVector3D(-5.0f, 3.5f, 3.5f), QVector3D(1, 0, 0), &distance), 60);
+    QCOMPARE(picker.pick(transforms, QVector3D(-5.0f, 10.0f, 0.0f), QVector3D(1, 0, 0), &distance), -1);
+}
+
+void TestCubePicker::emptyScene()
+{
+    CubePicker picker;
+    QCOMPARE(picker.pick(QList<CubeTransform>(), QVector3D(0, 0, 5), QVector3D(0, 0, -1)), -1);
+}
+
+QTEST_APPLESS_MAIN(TestCubePicker)
+
+#include "tst_cubepicker.moc"
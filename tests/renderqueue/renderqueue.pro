@@ -0,0 +1,18 @@
+QT = core gui opengl testlib
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+TARGET = tst_renderqueue
+TEMPLATE = app
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    ../../framearena.cpp \
+    ../../renderqueue.cpp \
+    tst_renderqueue.cpp
+
+HEADERS += \
+    ../../framearena.h \
+    ../../renderqueue.h
@@ -0,0 +1,112 @@
+/**
+ * @file tst_renderqueue.cpp
+ * @brief Ordering of render queue sort keys and of the radix sort.
+ */
+
+#include "framearena.h"
+#include "renderqueue.h"
+#include <QRandomGenerator>
+#include <QtTest>
+#include <algorithm>
+
+class TestRenderQueue : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void keyOrder();
+    void sortMatchesStableSort_data();
+    void sortMatchesStableSort();
+    void sortKeepsSubmissionOrderForEqualKeys();
+};
+
+namespace {
+/**
+ * @brief Sorts a copy of entries with the radix sort and with std::stable_sort and compares
+ * the (key, packet) sequences.
+ */
+void compareWithStableSort(const QList<RenderQueue::SortEntry> &entries)
+{
+    FrameArena arena(1024);
+    RenderQueue::SortEntry *input = arena.allocateArray<RenderQueue::SortEntry>(entries.size());
+    std::copy(entries.cbegin(), entries.cend(), input);
+    const RenderQueue::SortEntry *sorted = RenderQueue::sortByKey(input, int(entries.size()), arena);
+
+    QList<RenderQueue::SortEntry> expected = entries;
+    std::stable_sort(expected.begin(), expected.end(),
+                     [](const RenderQueue::SortEntry &a, const RenderQueue::SortEntry &b) { return a.key < b.key; });
+    for (int i = 0; i < expected.size(); ++i) {
+        QCOMPARE(sorted[i].key, expected.at(i).key);
+        QCOMPARE(sorted[i].packet, expected.at(i).packet);
+    }
+}
+}
+
+void TestRenderQueue::keyOrder()
+{
+    using Q = RenderQueue;
+    // Passes come first, then program, texture and VAO.
+    QVERIFY(Q::makeKey(Q::Opaque, 255, 4094, 255, 1e30f) < Q::makeKey(Q::Transparent, 0, 0, 0, 0.0f));
+    QVERIFY(Q::makeKey(Q::Transparent, 255, -1, 255, 0.0f) < Q::makeKey(Q::Overlay, 0, 0, 0, 0.0f));
+    QVERIFY(Q::makeKey(Q::Opaque, 1, 9, 9, 1e30f) < Q::makeKey(Q::Opaque, 2, 0, 0, 0.0f));
+    QVERIFY(Q::makeKey(Q::Opaque, 1, 1, 9, 1e30f) < Q::makeKey(Q::Opaque, 1, 2, 0, 0.0f));
+    QVERIFY(Q::makeKey(Q::Opaque, 1, 1, 1, 1e30f) < Q::makeKey(Q::Opaque, 1, 1, 2, 0.0f));
+    // Textured packets sort before untextured ones of the same program.
+    QVERIFY(Q::makeKey(Q::Opaque, 1, 4094, 1, 0.0f) < Q::makeKey(Q::Opaque, 1, -1, 1, 0.0f));
+    // Opaque packets go front to back, transparent ones back to front.
+    QVERIFY(Q::makeKey(Q::Opaque, 1, 1, 1, 0.5f) < Q::makeKey(Q::Opaque, 1, 1, 1, 2.0f));
+    QVERIFY(Q::makeKey(Q::Transparent, 1, 1, 1, 2.0f) < Q::makeKey(Q::Transparent, 1, 1, 1, 0.5f));
+    // Depths behind the camera (and NaN) clamp to zero.
+    QCOMPARE(Q::makeKey(Q::Opaque, 1, 1, 1, -3.0f), Q::makeKey(Q::Opaque, 1, 1, 1, 0.0f));
+    QCOMPARE(Q::makeKey(Q::Opaque, 1, 1, 1, qQNaN()), Q::makeKey(Q::Opaque, 1, 1, 1, 0.0f));
+}
+
+void TestRenderQueue::sortMatchesStableSort_data()
+{
+    QTest::addColumn<int>("count");
+    QTest::addColumn<int>("programs");
+    QTest::newRow("empty") << 0 << 1;
+    QTest::newRow("one") << 1 << 1;
+    QTest::newRow("few") << 7 << 3;
+    QTest::newRow("frame") << 5000 << 8;
+    QTest::newRow("many programs") << 20000 << 256;
+}
+
+void TestRenderQueue::sortMatchesStableSort()
+{
+    QFETCH(int, count);
+    QFETCH(int, programs);
+    QRandomGenerator random(quint32(count));
+    QList<RenderQueue::SortEntry> entries;
+    for (int i = 0; i < count; ++i) {
+        const auto pass = RenderQueue::Pass(random.bounded(3));
+        const int program = int(random.bounded(programs));
+        const int texture = int(random.bounded(5)) - 1;
+        const int vao = int(random.bounded(4));
+        const float depth = float(random.generateDouble() * 100.0);
+        entries.append(RenderQueue::SortEntry{RenderQueue::makeKey(pass, program, texture, vao, depth), i});
+    }
+    compareWithStableSort(entries);
+}
+
+void TestRenderQueue::sortKeepsSubmissionOrderForEqualKeys()
+{
+    // Overlay lines share a key per depth; the sort must keep their submission order.
+    QRandomGenerator random(7);
+    QList<RenderQueue::SortEntry> entries;
+    for (int i = 0; i < 3000; ++i) {
+        const quint64 key = RenderQueue::makeKey(RenderQueue::Overlay, 1, 2, 3, float(random.bounded(4)));
+        entries.append(RenderQueue::SortEntry{key, i});
+    }
+    compareWithStableSort(entries);
+
+    // Keys differing only in the top digit exercise the last pass on its own.
+    entries.clear();
+    for (int i = 0; i < 1000; ++i)
+        entries.append(RenderQueue::SortEntry{quint64(random.bounded(256)) << 56, i});
+    compareWithStableSort(entries);
+}
+
+QTEST_APPLESS_MAIN(TestRenderQueue)
+
+#include "tst_renderqueue.moc"
@@ -0,0 +1,16 @@
+QT = core gui testlib
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+TARGET = tst_scenefile
+TEMPLATE = app
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    ../../scenefile.cpp \
+    tst_scenefile.cpp
+
+HEADERS += \
+    ../../scenefile.h
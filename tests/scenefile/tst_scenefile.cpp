@@ -0,0 +1,235 @@
+/**
+ * @file tst_scenefile.cpp
+ * @brief Round trip of the binary scene format and rejection of corrupt files.
+ */
+
+#include "cubeinstance.h"
+#include "lightcluster.h"
+#include "scenefile.h"
+#include <QTemporaryDir>
+#include <QtTest>
+#include <cstddef>
+#include <cstring>
+
+using namespace SceneFormat;
+
+class TestSceneFile : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void roundTrip();
+    void streamedSections();
+    void rejectsWrongStride();
+    void rejectsSectionPastEnd();
+    void rejectsMisalignedSection();
+    void rejectsBadHeader();
+
+private:
+    QString writeDefaultScene(const QString &name);
+    static void patchFile(const QString &path, qint64 offset, const void *bytes, qint64 size);
+
+    QTemporaryDir dir;
+};
+
+namespace {
+QList<CubeTransform> makeTransforms(int count)
+{
+    QList<CubeTransform> transforms;
+    for (int i = 0; i < count; ++i) {
+        CubeTransform t = CubeTransform::identity();
+        t.setTranslation(QVector3D(float(i), 2.0f * i, -0.5f * i));
+        t.scale = 0.25f + 0.01f * i;
+        t.setRotation(QQuaternion::fromAxisAndAngle(QVector3D(1, 2, 3), 7.0f * i));
+        transforms.append(t);
+    }
+    return transforms;
+}
+
+Light makeLight(int i)
+{
+    Light light;
+    std::memset(&light, 0, sizeof(light));
+    light.position[0] = float(i);
+    light.range = 4.0f + i;
+    light.color[1] = 0.5f;
+    light.intensity = 1.5f;
+    light.type = float(i % 2 ? Light::Spot : Light::Point);
+    return light;
+}
+}
+
+/**
+ * @brief Writes a scene with two cubes and one light, returning its path.
+ */
+QString TestSceneFile::writeDefaultScene(const QString &name)
+{
+    const QString path = dir.filePath(name);
+    const QList<CubeTransform> transforms = makeTransforms(2);
+    const quint32 phases[2] = {0, 3};
+    const Light light = makeLight(0);
+    SceneWriter writer(path);
+    const bool ok = writer.open()
+            && writer.writeSection(Transforms, sizeof(CubeTransform), transforms.constData(), transforms.size())
+            && writer.writeSection(TexturePhases, sizeof(quint32), phases, 2)
+            && writer.writeSection(Lights, sizeof(Light), &light, 1)
+            && writer.close();
+    if (!ok)
+        qWarning() << writer.errorString();
+    return ok ? path : QString();
+}
+
+void TestSceneFile::patchFile(const QString &path, qint64 offset, const void *bytes, qint64 size)
+{
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::ReadWrite));
+    QVERIFY(file.seek(offset));
+    QCOMPARE(file.write(static_cast<const char *>(bytes), size), size);
+}
+
+void TestSceneFile::roundTrip()
+{
+    QVERIFY(dir.isValid());
+    const QString path = dir.filePath("round.cubescene");
+    SceneSettings settings = {{1, 2, 3}, 4.0f, {5, 6, 7}, 1u, {0, 0, -1}, 0u};
+    const QList<CubeTransform> transforms = makeTransforms(37);
+    QList<quint32> phases;
+    QList<CubeAnimation> animations;
+    for (int i = 0; i < transforms.size(); ++i) {
+        phases.append(quint32(i % 5));
+        animations.append(i % 2 ? CubeAnimation::spin(QVector3D(0, 1, 0), 1.0f + i)
+                                : CubeAnimation::aboutLine(QVector3D(i, 0, 0), QVector3D(0, 0, 1), -2.0f));
+    }
+    const QList<Light> lights = {makeLight(0), makeLight(1), makeLight(2)};
+
+    SceneWriter writer(path);
+    QVERIFY(writer.open());
+    QVERIFY(writer.writeSection(Settings, sizeof(settings), &settings, 1));
+    QVERIFY(writer.writeSection(Transforms, sizeof(CubeTransform), transforms.constData(), transforms.size()));
+    QVERIFY(writer.writeSection(TexturePhases, sizeof(quint32), phases.constData(), phases.size()));
+    QVERIFY(writer.writeSection(Lights, sizeof(Light), lights.constData(), lights.size()));
+    QVERIFY(writer.writeSection(Animations, sizeof(CubeAnimation), animations.constData(), animations.size()));
+    QVERIFY2(writer.close(), qPrintable(writer.errorString()));
+
+    MappedScene scene;
+    QVERIFY2(scene.open(path), qPrintable(scene.errorString()));
+    QVERIFY(scene.settings());
+    QCOMPARE(std::memcmp(scene.settings(), &settings, sizeof(settings)), 0);
+
+    qint64 count = 0;
+    const CubeTransform *readTransforms = scene.transforms(&count);
+    QCOMPARE(count, qint64(transforms.size()));
+    QCOMPARE(std::memcmp(readTransforms, transforms.constData(), count * sizeof(CubeTransform)), 0);
+    QCOMPARE(quintptr(readTransforms) % quintptr(SectionAlignment), quintptr(0));
+
+    const quint32 *readPhases = scene.texturePhases(&count);
+    QCOMPARE(count, qint64(phases.size()));
+    QCOMPARE(std::memcmp(readPhases, phases.constData(), count * sizeof(quint32)), 0);
+
+    const Light *readLights = scene.lights(&count);
+    QCOMPARE(count, qint64(lights.size()));
+    QCOMPARE(std::memcmp(readLights, lights.constData(), count * sizeof(Light)), 0);
+
+    const CubeAnimation *readAnimations = scene.animations(&count);
+    QCOMPARE(count, qint64(animations.size()));
+    QCOMPARE(std::memcmp(readAnimations, animations.constData(), count * sizeof(CubeAnimation)), 0);
+}
+
+void TestSceneFile::streamedSections()
+{
+    // A section appended in chunks reads back as one array; missing sections are empty.
+    const QString path = dir.filePath("streamed.cubescene");
+    const QList<CubeTransform> transforms = makeTransforms(10);
+    SceneWriter writer(path);
+    QVERIFY(writer.open());
+    QVERIFY(writer.beginSection(Transforms, sizeof(CubeTransform)));
+    QVERIFY(writer.append(transforms.constData(), 3));
+    QVERIFY(writer.append(transforms.constData() + 3, 7));
+    QVERIFY(writer.endSection());
+    QVERIFY(writer.close());
+
+    MappedScene scene;
+    QVERIFY2(scene.open(path), qPrintable(scene.errorString()));
+    qint64 count = 0;
+    const CubeTransform *readTransforms = scene.transforms(&count);
+    QCOMPARE(count, qint64(10));
+    QCOMPARE(std::memcmp(readTransforms, transforms.constData(), count * sizeof(CubeTransform)), 0);
+    QVERIFY(!scene.settings());
+    QVERIFY(!scene.animations(&count));
+    QCOMPARE(count, qint64(0));
+}
+
+void TestSceneFile::rejectsWrongStride()
+{
+    const QString path = dir.filePath("stride.cubescene");
+    const float records[8] = {};
+    SceneWriter writer(path);
+    QVERIFY(writer.open());
+    QVERIFY(writer.writeSection(Transforms, 16, records, 2));
+    QVERIFY(writer.close());
+
+    MappedScene scene;
+    QVERIFY(!scene.open(path));
+    QVERIFY(scene.errorString().contains("record size"));
+}
+
+void TestSceneFile::rejectsSectionPastEnd()
+{
+    const QString path = writeDefaultScene("past-end.cubescene");
+    QVERIFY(!path.isEmpty());
+    // Claim far more transforms than the file holds; the first directory entry is Transforms.
+    const quint64 count = quint64(1) << 40;
+    patchFile(path, sizeof(Header) + offsetof(SectionEntry, count), &count, sizeof(count));
+
+    MappedScene scene;
+    QVERIFY(!scene.open(path));
+    QVERIFY(scene.errorString().contains("exceeds"));
+
+    const quint64 offset = quint64(1) << 20;
+    const QString other = writeDefaultScene("offset-past-end.cubescene");
+    patchFile(other, sizeof(Header) + offsetof(SectionEntry, offset), &offset, sizeof(offset));
+    QVERIFY(!scene.open(other));
+}
+
+void TestSceneFile::rejectsMisalignedSection()
+{
+    const QString path = writeDefaultScene("misaligned.cubescene");
+    QVERIFY(!path.isEmpty());
+    QFile file(path);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    file.seek(sizeof(Header));
+    SectionEntry entry;
+    QCOMPARE(file.read(reinterpret_cast<char *>(&entry), sizeof(entry)), qint64(sizeof(entry)));
+    file.close();
+    entry.offset += 4;
+    patchFile(path, sizeof(Header), &entry, sizeof(entry));
+
+    MappedScene scene;
+    QVERIFY(!scene.open(path));
+}
+
+void TestSceneFile::rejectsBadHeader()
+{
+    MappedScene scene;
+    const QString tiny = dir.filePath("tiny.cubescene");
+    QFile file(tiny);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write("CUB", 3);
+    file.close();
+    QVERIFY(!scene.open(tiny));
+
+    const QString path = writeDefaultScene("header.cubescene");
+    const quint32 version = Version + 1;
+    patchFile(path, offsetof(Header, version), &version, sizeof(version));
+    QVERIFY(!scene.open(path));
+    QVERIFY(scene.errorString().contains("version"));
+
+    const QString capacity = writeDefaultScene("capacity.cubescene");
+    const quint32 sections = DirectoryCapacity + 1;
+    patchFile(capacity, offsetof(Header, sectionCount), &sections, sizeof(sections));
+    QVERIFY(!scene.open(capacity));
+}
+
+QTEST_APPLESS_MAIN(TestSceneFile)
+
+#include "tst_scenefile.moc"
@@ -0,0 +1,8 @@
+# Unit tests, built separately from the application: qmake tests/tests.pro && make check
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    cubepicker \
+    renderqueue \
+    scenefile \
+    texbaker
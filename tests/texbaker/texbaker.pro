@@ -0,0 +1,18 @@
+QT = core gui testlib
+
+CONFIG += c++17 console testcase
+CONFIG -= app_bundle
+
+TARGET = tst_texbaker
+TEMPLATE = app
+
+INCLUDEPATH += ../.. ../../tools/texbaker
+
+SOURCES += \
+    ../../ktxfile.cpp \
+    ../../tools/texbaker/texturecompressor.cpp \
+    tst_texbaker.cpp
+
+HEADERS += \
+    ../../ktxfile.h \
+    ../../tools/texbaker/texturecompressor.h
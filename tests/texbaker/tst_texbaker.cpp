@@ -0,0 +1,368 @@
+/**
+ * @file tst_texbaker.cpp
+ * @brief KTX container round trip and BC1/ETC1 block encoding, checked with reference
+ * decoders written from the format specifications.
+ */
+
+#include "ktxfile.h"
+#include "texturecompressor.h"
+#include <QImage>
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+#include <QtTest>
+#include <algorithm>
+#include <cstdlib>
+
+class TestTexBaker : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void solidBlocks();
+    void splitBlocks_data();
+    void splitBlocks();
+    void differentialStaysInEtc1Range();
+    void gradientQuality();
+    void compressImageLayout();
+    void ktxRoundTrip();
+    void ktxCompressedLevels();
+    void ktxRejectsCorruptFiles();
+
+private:
+    QTemporaryDir dir;
+};
+
+namespace {
+using Block = quint8[16 * 4];
+
+void expandRgb565(quint16 color, int *rgb)
+{
+    const int r = (color >> 11) & 31;
+    const int g = (color >> 5) & 63;
+    const int b = color & 31;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+/// BC1 (DXT1) decoder, both the four-color and the three-color + black mode.
+void decodeBc1(const quint8 *block, quint8 *pixels)
+{
+    const quint16 color0 = quint16(block[0] | block[1] << 8);
+    const quint16 color1 = quint16(block[2] | block[3] << 8);
+    int palette[4][3];
+    expandRgb565(color0, palette[0]);
+    expandRgb565(color1, palette[1]);
+    for (int c = 0; c < 3; ++c) {
+        if (color0 > color1) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        } else {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+    const quint32 indices = quint32(block[4]) | quint32(block[5]) << 8 | quint32(block[6]) << 16
+            | quint32(block[7]) << 24;
+    for (int i = 0; i < 16; ++i) {
+        const int index = (indices >> (2 * i)) & 3;
+        for (int c = 0; c < 3; ++c)
+            pixels[i * 4 + c] = quint8(palette[index][c]);
+        pixels[i * 4 + 3] = 255;
+    }
+}
+
+/// ETC1 decoder. Returns false for a differential block whose second color leaves the 5-bit
+/// range, which ETC2 decoders would read as a T, H or planar block.
+bool decodeEtc1(const quint8 *block, quint8 *pixels)
+{
+    static const int tables[8][2] = {
+        {2, 8}, {5, 17}, {9, 29}, {13, 42}, {18, 60}, {24, 80}, {33, 106}, {47, 183}
+    };
+    const quint32 high = quint32(block[0]) << 24 | quint32(block[1]) << 16 | quint32(block[2]) << 8 | block[3];
+    const quint32 low = quint32(block[4]) << 24 | quint32(block[5]) << 16 | quint32(block[6]) << 8 | block[7];
+    const bool flip = high & 1;
+    const bool differential = high & 2;
+    int base[2][3];
+    for (int c = 0; c < 3; ++c) {
+        const int shift = 24 - c * 8;
+        if (differential) {
+            const int first = (high >> (shift + 3)) & 31;
+            int delta = (high >> shift) & 7;
+            if (delta >= 4)
+                delta -= 8;
+            const int second = first + delta;
+            if (second < 0 || second > 31)
+                return false;
+            base[0][c] = (first << 3) | (first >> 2);
+            base[1][c] = (second << 3) | (second >> 2);
+        } else {
+            base[0][c] = int((high >> (shift + 4)) & 15) * 17;
+            base[1][c] = int((high >> shift) & 15) * 17;
+        }
+    }
+    const int table[2] = {int(high >> 5) & 7, int(high >> 2) & 7};
+    for (int y = 0; y < 4; ++y) {
+        for (int x = 0; x < 4; ++x) {
+            const int subBlock = flip ? y / 2 : x / 2;
+            const int bit = x * 4 + y;
+            const int index = int((low >> (16 + bit)) & 1) << 1 | int((low >> bit) & 1);
+            const int magnitude = tables[table[subBlock]][index & 1];
+            const int modifier = index & 2 ? -magnitude : magnitude;
+            for (int c = 0; c < 3; ++c)
+                pixels[(y * 4 + x) * 4 + c] = quint8(std::clamp(base[subBlock][c] + modifier, 0, 255));
+            pixels[(y * 4 + x) * 4 + 3] = 255;
+        }
+    }
+    return true;
+}
+
+int maxError(const quint8 *a, const quint8 *b)
+{
+    int error = 0;
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < 3; ++c)
+            error = std::max(error, std::abs(int(a[i * 4 + c]) - int(b[i * 4 + c])));
+    return error;
+}
+
+double meanSquaredError(const quint8 *a, const quint8 *b)
+{
+    double error = 0.0;
+    for (int i = 0; i < 16; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            const int d = int(a[i * 4 + c]) - int(b[i * 4 + c]);
+            error += d * d;
+        }
+    }
+    return error / 48.0;
+}
+
+void fillBlock(Block pixels, const int *first, const int *second, bool flip)
+{
+    for (int y = 0; y < 4; ++y) {
+        for (int x = 0; x < 4; ++x) {
+            const int *color = (flip ? y / 2 : x / 2) ? second : first;
+            for (int c = 0; c < 3; ++c)
+                pixels[(y * 4 + x) * 4 + c] = quint8(color[c]);
+            pixels[(y * 4 + x) * 4 + 3] = 255;
+        }
+    }
+}
+
+QByteArray pattern(int bytes, int seed)
+{
+    QByteArray data(bytes, Qt::Uninitialized);
+    for (int i = 0; i < bytes; ++i)
+        data[i] = char(i * 7 + seed);
+    return data;
+}
+}
+
+void TestTexBaker::solidBlocks()
+{
+    // A uniform block only loses the endpoint quantization (RGB565 for BC1, 4 or 5 bits
+    // plus the nearest modifier for ETC1).
+    QRandomGenerator random(1);
+    for (int n = 0; n < 500; ++n) {
+        const int color[3] = {int(random.bounded(256)), int(random.bounded(256)), int(random.bounded(256))};
+        Block pixels, decoded;
+        fillBlock(pixels, color, color, false);
+        quint8 block[8];
+        TextureCompressor::encodeBc1Block(pixels, block);
+        decodeBc1(block, decoded);
+        QVERIFY(maxError(pixels, decoded) <= 4);
+        TextureCompressor::encodeEtc2Block(pixels, block);
+        QVERIFY(decodeEtc1(block, decoded));
+        QVERIFY(maxError(pixels, decoded) <= 8);
+    }
+}
+
+void TestTexBaker::splitBlocks_data()
+{
+    QTest::addColumn<bool>("flip");
+    QTest::newRow("left/right") << false;
+    QTest::newRow("top/bottom") << true;
+}
+
+void TestTexBaker::splitBlocks()
+{
+    // Two unrelated colors need individual mode and the subblock layout that separates them.
+    QFETCH(bool, flip);
+    const int first[3] = {60, 120, 200};
+    const int second[3] = {200, 90, 30};
+    Block pixels, decoded;
+    fillBlock(pixels, first, second, flip);
+    quint8 block[8];
+    TextureCompressor::encodeEtc2Block(pixels, block);
+    QCOMPARE(bool(block[3] & 1), flip);
+    QVERIFY(decodeEtc1(block, decoded));
+    QVERIFY(maxError(pixels, decoded) <= 8);
+
+    TextureCompressor::encodeBc1Block(pixels, block);
+    decodeBc1(block, decoded);
+    QVERIFY(maxError(pixels, decoded) <= 4);
+    QVERIFY(quint16(block[0] | block[1] << 8) > quint16(block[2] | block[3] << 8)); // four-color mode
+}
+
+void TestTexBaker::differentialStaysInEtc1Range()
+{
+    // Close colors use differential mode; no block may decode as an ETC2-only mode.
+    const int first[3] = {100, 100, 100};
+    const int second[3] = {110, 104, 96};
+    Block pixels, decoded;
+    quint8 block[8];
+    fillBlock(pixels, first, second, false);
+    TextureCompressor::encodeEtc2Block(pixels, block);
+    QVERIFY(block[3] & 2);
+    QVERIFY(decodeEtc1(block, decoded));
+    QVERIFY(maxError(pixels, decoded) <= 8);
+
+    QRandomGenerator random(2);
+    for (int n = 0; n < 2000; ++n) {
+        for (quint8 &value : pixels)
+            value = quint8(random.bounded(256));
+        TextureCompressor::encodeEtc2Block(pixels, block);
+        QVERIFY(decodeEtc1(block, decoded));
+    }
+}
+
+void TestTexBaker::gradientQuality()
+{
+    // Smooth gradients are what the texture strip holds; both codecs must stay close.
+    QRandomGenerator random(3);
+    double bc1Error = 0.0, etcError = 0.0;
+    const int blocks = 1000;
+    for (int n = 0; n < blocks; ++n) {
+        const int origin[3] = {int(random.bounded(256)), int(random.bounded(256)), int(random.bounded(256))};
+        const int slope[3] = {int(random.bounded(33)) - 16, int(random.bounded(33)) - 16, int(random.bounded(33)) - 16};
+        Block pixels, decoded;
+        for (int y = 0; y < 4; ++y) {
+            for (int x = 0; x < 4; ++x) {
+                quint8 *p = pixels + (y * 4 + x) * 4;
+                p[0] = quint8(std::clamp(origin[0] + slope[0] * x, 0, 255));
+                p[1] = quint8(std::clamp(origin[1] + slope[1] * y, 0, 255));
+                p[2] = quint8(std::clamp(origin[2] + slope[2] * (x + y) / 2, 0, 255));
+                p[3] = 255;
+            }
+        }
+        quint8 block[8];
+        TextureCompressor::encodeBc1Block(pixels, block);
+        decodeBc1(block, decoded);
+        bc1Error += meanSquaredError(pixels, decoded);
+        TextureCompressor::encodeEtc2Block(pixels, block);
+        QVERIFY(decodeEtc1(block, decoded));
+        etcError += meanSquaredError(pixels, decoded);
+    }
+    QVERIFY2(bc1Error / blocks < 40.0, qPrintable(QString::number(bc1Error / blocks)));
+    QVERIFY2(etcError / blocks < 45.0, qPrintable(QString::number(etcError / blocks)));
+}
+
+void TestTexBaker::compressImageLayout()
+{
+    // A 6x5 image has 2x2 blocks, stored row by row; the partial blocks repeat edge pixels.
+    const QRgb colors[4] = {qRgb(255, 0, 0), qRgb(0, 255, 0), qRgb(0, 0, 255), qRgb(255, 255, 255)};
+    QImage image(6, 5, QImage::Format_RGBA8888);
+    for (int y = 0; y < image.height(); ++y)
+        for (int x = 0; x < image.width(); ++x)
+            image.setPixel(x, y, colors[(y / 4) * 2 + x / 4]);
+
+    const QByteArray bc1 = TextureCompressor::compressBc1(image);
+    const QByteArray etc = TextureCompressor::compressEtc2(image);
+    QCOMPARE(bc1.size(), 4 * 8);
+    QCOMPARE(etc.size(), 4 * 8);
+    for (int b = 0; b < 4; ++b) {
+        const int expected[3] = {qRed(colors[b]), qGreen(colors[b]), qBlue(colors[b])};
+        Block pixels, decoded;
+        fillBlock(pixels, expected, expected, false);
+        decodeBc1(reinterpret_cast<const quint8 *>(bc1.constData()) + b * 8, decoded);
+        QVERIFY(maxError(pixels, decoded) <= 4);
+        QVERIFY(decodeEtc1(reinterpret_cast<const quint8 *>(etc.constData()) + b * 8, decoded));
+        QVERIFY(maxError(pixels, decoded) <= 8);
+    }
+}
+
+void TestTexBaker::ktxRoundTrip()
+{
+    // A 4x2 RGBA8 array texture with two layers and a full mip chain (4x2, 2x1, 1x1).
+    QVERIFY(dir.isValid());
+    const QString path = dir.filePath("array.ktx");
+    const QList<QByteArray> levels = {pattern(2 * 32, 1), pattern(2 * 8, 2), pattern(2 * 4, 3)};
+    const KtxFormat::Header header = KtxFormat::makeHeader(KtxFormat::Rgba8, 4, 2, 2, 3);
+    QString error;
+    QVERIFY2(KtxFile::write(path, header, levels, &error), qPrintable(error));
+
+    KtxFile file;
+    QVERIFY2(file.open(path), qPrintable(file.errorString()));
+    QCOMPARE(file.header().glInternalFormat, quint32(KtxFormat::Rgba8));
+    QCOMPARE(file.layers(), 2);
+    QCOMPARE(file.levelCount(), 3);
+    QCOMPARE(file.width(1), 2);
+    QCOMPARE(file.height(1), 1);
+    for (int level = 0; level < levels.size(); ++level) {
+        for (int layer = 0; layer < 2; ++layer) {
+            qint64 bytes = 0;
+            const uchar *data = file.layerData(level, layer, &bytes);
+            QCOMPARE(bytes, qint64(levels.at(level).size() / 2));
+            QCOMPARE(QByteArray(reinterpret_cast<const char *>(data), bytes),
+                     levels.at(level).mid(layer * bytes, bytes));
+        }
+    }
+}
+
+void TestTexBaker::ktxCompressedLevels()
+{
+    // Levels smaller than a block still take a whole 8-byte block.
+    const QString path = dir.filePath("bc1.ktx");
+    QCOMPARE(KtxFormat::imageSize(KtxFormat::CompressedRgbS3tcDxt1, 8, 8), qint64(32));
+    QCOMPARE(KtxFormat::imageSize(KtxFormat::CompressedRgb8Etc2, 2, 1), qint64(8));
+    const QList<QByteArray> levels = {pattern(32, 4), pattern(8, 5), pattern(8, 6), pattern(8, 7)};
+    QVERIFY(KtxFile::write(path, KtxFormat::makeHeader(KtxFormat::CompressedRgbS3tcDxt1, 8, 8, 1, 4), levels));
+
+    KtxFile file;
+    QVERIFY2(file.open(path), qPrintable(file.errorString()));
+    QVERIFY(KtxFormat::isCompressed(file.header().glInternalFormat));
+    QCOMPARE(file.header().glFormat, quint32(0));
+    QCOMPARE(file.layers(), 1);
+    QCOMPARE(file.levelCount(), 4);
+    qint64 bytes = 0;
+    const uchar *data = file.layerData(3, 0, &bytes);
+    QCOMPARE(QByteArray(reinterpret_cast<const char *>(data), bytes), levels.last());
+}
+
+void TestTexBaker::ktxRejectsCorruptFiles()
+{
+    KtxFile file;
+    const KtxFormat::Header header = KtxFormat::makeHeader(KtxFormat::Rgba8, 4, 4, 1, 1);
+
+    const QString wrongSize = dir.filePath("wrong-size.ktx");
+    QVERIFY(KtxFile::write(wrongSize, header, {pattern(60, 1)}));
+    QVERIFY(!file.open(wrongSize));
+
+    // A 1x1 texture cannot have a second mip level.
+    const QString tooManyLevels = dir.filePath("levels.ktx");
+    QVERIFY(KtxFile::write(tooManyLevels, KtxFormat::makeHeader(KtxFormat::Rgba8, 1, 1, 1, 2),
+                           {pattern(4, 1), pattern(4, 2)}));
+    QVERIFY(!file.open(tooManyLevels));
+
+    const QString truncated = dir.filePath("truncated.ktx");
+    QVERIFY(KtxFile::write(truncated, header, {pattern(64, 1)}));
+    QFile raw(truncated);
+    QVERIFY(raw.resize(raw.size() - 8));
+    QVERIFY(!file.open(truncated));
+
+    const QString unsupported = dir.filePath("unsupported.ktx");
+    QVERIFY(KtxFile::write(unsupported, KtxFormat::makeHeader(0x8C43, 4, 4, 1, 1), {pattern(64, 1)}));
+    QVERIFY(!file.open(unsupported));
+
+    const QString notKtx = dir.filePath("not.ktx");
+    QFile other(notKtx);
+    QVERIFY(other.open(QIODevice::WriteOnly));
+    other.write(QByteArray(128, 'x'));
+    other.close();
+    QVERIFY(!file.open(notKtx));
+}
+
+QTEST_APPLESS_MAIN(TestTexBaker)
+
+#include "tst_texbaker.moc"
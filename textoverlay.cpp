@@ -0,0 +1,321 @@
+/**
+ * @file textoverlay.cpp
+ * @brief Implementation of the allocation-free status text overlay.
+ */
+
+#include "textoverlay.h"
+#include <QFontMetricsF>
+#include <QImage>
+#include <QPainter>
+#include <algorithm>
+#include <cmath>
+
+/**
+ * @brief Starts an empty line in memory taken from the frame arena.
+ */
+OverlayLine::OverlayLine(FrameArena &arena)
+    : chars(arena.allocateArray<char>(MaxLength + 1)),
+      length(0)
+{
+    chars[0] = '\0';
+}
+
+void OverlayLine::append(char c)
+{
+    if (length < MaxLength) {
+        chars[length++] = c;
+        chars[length] = '\0';
+    }
+}
+
+/**
+ * @brief Appends a NUL-terminated string.
+ */
+OverlayLine &OverlayLine::operator<<(const char *text)
+{
+    while (*text)
+        append(*text++);
+    return *this;
+}
+
+/**
+ * @brief Appends an integer in decimal.
+ */
+OverlayLine &OverlayLine::operator<<(qint64 value)
+{
+    if (value < 0)
+        append('-');
+    quint64 magnitude = value < 0 ? quint64(0) - quint64(value) : quint64(value);
+    char digits[20];
+    int count = 0;
+    do {
+        digits[count++] = char('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+    while (count)
+        append(digits[--count]);
+    return *this;
+}
+
+/**
+ * @brief Appends a number with a fixed number of decimals (at most 9), rounded to nearest.
+ */
+OverlayLine &OverlayLine::operator<<(Fixed value)
+{
+    if (!std::isfinite(value.value))
+        return *this << "nan";
+    const int decimals = std::clamp(value.decimals, 0, 9);
+    quint64 scale = 1;
+    for (int i = 0; i < decimals; ++i)
+        scale *= 10;
+    if (value.value < 0.0)
+        append('-');
+    const quint64 scaled = quint64(std::llround(std::fabs(value.value) * double(scale)));
+    *this << qint64(scaled / scale);
+    if (decimals > 0) {
+        append('.');
+        quint64 fraction = scaled % scale;
+        for (quint64 digit = scale / 10; digit > 0; digit /= 10) {
+            append(char('0' + fraction / digit));
+            fraction %= digit;
+        }
+    }
+    return *this;
+}
+
+/**
+ * @brief Constructs an overlay; GL resources are created by initialize().
+ */
+TextOverlay::TextOverlay()
+    : atlas(nullptr),
+      atlasPixelRatio(0.0),
+      cellWidth(0.0f),
+      cellHeight(0.0f),
+      ascent(0.0f),
+      advances(),
+      scaleLocation(-1),
+      colorLocation(-1),
+      atlasLocation(-1),
+      renderQueue(nullptr),
+      programId(-1),
+      vaoId(-1),
+      atlasId(-1),
+      vertices(nullptr),
+      glyphCount(0),
+      lines(nullptr),
+      lineCount(0),
+      viewWidth(1),
+      viewHeight(1)
+{
+}
+
+/**
+ * @brief Destroys the overlay. destroy() must have been called with the context current.
+ */
+TextOverlay::~TextOverlay()
+{
+}
+
+/**
+ * @brief Compiles the text shader, creates the vertex buffer and registers both with the
+ * render queue that will draw the text. The context must be current; setFont() must be
+ * called before the first frame.
+ */
+void TextOverlay::initialize(RenderQueue &queue)
+{
+    initializeOpenGLFunctions();
+
+    const char *vertexSrc = R"(
+        #version 330 core
+        layout(location = 0) in vec4 aVertex; // xy: position in pixels, zw: atlas coordinates
+        uniform vec2 uScale;
+        out vec2 vTexCoord;
+        void main() {
+            vTexCoord = aVertex.zw;
+            gl_Position = vec4(aVertex.x * uScale.x - 1.0, 1.0 - aVertex.y * uScale.y, 0.0, 1.0);
+        }
+    )";
+    const char *fragmentSrc = R"(
+        #version 330 core
+        in vec2 vTexCoord;
+        uniform sampler2D uAtlas;
+        uniform vec4 uColor;
+        out vec4 fragColor;
+        void main() {
+            fragColor = vec4(uColor.rgb, uColor.a * texture(uAtlas, vTexCoord).a);
+        }
+    )";
+    program.addShaderFromSourceCode(QOpenGLShader::Vertex, vertexSrc);
+    program.addShaderFromSourceCode(QOpenGLShader::Fragment, fragmentSrc);
+    program.link();
+    scaleLocation = program.uniformLocation("uScale");
+    colorLocation = program.uniformLocation("uColor");
+    atlasLocation = program.uniformLocation("uAtlas");
+
+    vao.create();
+    vao.bind();
+    vbo.create();
+    vbo.setUsagePattern(QOpenGLBuffer::DynamicDraw);
+    vbo.bind();
+    vbo.allocate(MaxGlyphs * 6 * 4 * int(sizeof(float)));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), nullptr);
+    vao.release();
+    vbo.release();
+
+    renderQueue = &queue;
+    programId = queue.registerProgram(&program, [this](QOpenGLShaderProgram &p) {
+        p.setUniformValue(scaleLocation, 2.0f / viewWidth, 2.0f / viewHeight);
+        p.setUniformValue(colorLocation, 1.0f, 1.0f, 1.0f, 1.0f);
+        p.setUniformValue(atlasLocation, 0);
+    });
+    vaoId = queue.registerVao(&vao);
+}
+
+/**
+ * @brief Releases the GL resources. The context they were created in must be current.
+ */
+void TextOverlay::destroy()
+{
+    program.removeAllShaders();
+    vbo.destroy();
+    vao.destroy();
+    delete atlas;
+    atlas = nullptr;
+    atlasPixelRatio = 0.0;
+    renderQueue = nullptr;
+    programId = vaoId = atlasId = -1;
+}
+
+/**
+ * @brief Renders the glyph atlas for a font at a device pixel ratio, unless it is current.
+ *
+ * The glyphs are laid out in a grid with one logical pixel of padding around each cell, so
+ * linear filtering never picks up a neighbour. Metrics are in logical pixels; the texture
+ * has pixelRatio times as many texels so text stays sharp on high-DPI screens.
+ */
+void TextOverlay::setFont(const QFont &font, qreal pixelRatio)
+{
+    if (atlas && font == atlasFont && pixelRatio == atlasPixelRatio)
+        return;
+    atlasFont = font;
+    atlasPixelRatio = pixelRatio;
+
+    const QFontMetricsF metrics(font);
+    float widest = 0.0f;
+    for (int i = 0; i < GlyphCount; ++i) {
+        advances[i] = float(metrics.horizontalAdvance(QChar(FirstGlyph + i)));
+        widest = std::max(widest, advances[i]);
+    }
+    cellWidth = std::ceil(widest) + 2.0f;
+    cellHeight = std::ceil(float(metrics.height())) + 2.0f;
+    ascent = float(metrics.ascent());
+
+    const int rows = (GlyphCount + AtlasColumns - 1) / AtlasColumns;
+    QImage image(int(std::ceil(AtlasColumns * cellWidth * pixelRatio)),
+                 int(std::ceil(rows * cellHeight * pixelRatio)), QImage::Format_ARGB32_Premultiplied);
+    image.setDevicePixelRatio(pixelRatio);
+    image.fill(Qt::transparent);
+    QPainter painter(&image);
+    painter.setFont(font);
+    painter.setPen(Qt::white);
+    for (int i = 0; i < GlyphCount; ++i) {
+        const float x = (i % AtlasColumns) * cellWidth + 1.0f;
+        const float y = (i / AtlasColumns) * cellHeight + 1.0f + ascent;
+        painter.drawText(QPointF(x, y), QString(QChar(FirstGlyph + i)));
+    }
+    painter.end();
+
+    delete atlas;
+    atlas = new QOpenGLTexture(image, QOpenGLTexture::DontGenerateMipMaps);
+    atlas->setMinificationFilter(QOpenGLTexture::Linear);
+    atlas->setMagnificationFilter(QOpenGLTexture::Linear);
+    atlas->setWrapMode(QOpenGLTexture::ClampToEdge);
+    if (atlasId < 0)
+        atlasId = renderQueue->registerTexture(atlas);
+    else
+        renderQueue->replaceTexture(atlasId, atlas);
+}
+
+/**
+ * @brief Starts collecting the text of a frame.
+ * @param arena Frame arena that holds the vertices until draw().
+ * @param width Width of the target in logical pixels.
+ * @param height Height of the target in logical pixels.
+ */
+void TextOverlay::begin(FrameArena &arena, int width, int height)
+{
+    vertices = arena.allocateArray<float>(MaxGlyphs * 6 * 4);
+    glyphCount = 0;
+    lines = arena.allocateArray<LineRange>(MaxLines);
+    lineCount = 0;
+    viewWidth = std::max(width, 1);
+    viewHeight = std::max(height, 1);
+}
+
+/**
+ * @brief Adds a line of text.
+ * @param x Left edge in logical pixels.
+ * @param baseline Baseline in logical pixels from the top, as for QPainter::drawText().
+ * @param line The text; characters outside printable ASCII are shown as '?'.
+ */
+void TextOverlay::addText(float x, float baseline, const OverlayLine &line)
+{
+    if (!vertices || lineCount == MaxLines)
+        return;
+    const int firstGlyph = glyphCount;
+    const int rows = (GlyphCount + AtlasColumns - 1) / AtlasColumns;
+    const float atlasWidth = AtlasColumns * cellWidth;
+    const float atlasHeight = rows * cellHeight;
+    const float top = baseline - ascent - 1.0f;
+    float penX = x;
+    for (int i = 0; i < line.size() && glyphCount < MaxGlyphs; ++i) {
+        int glyph = quint8(line.text()[i]) - FirstGlyph;
+        if (glyph < 0 || glyph >= GlyphCount)
+            glyph = '?' - FirstGlyph;
+        if (glyph != 0) { // nothing to draw for a space
+            const float s0 = (glyph % AtlasColumns) * cellWidth / atlasWidth;
+            const float t0 = (glyph / AtlasColumns) * cellHeight / atlasHeight;
+            const float s1 = s0 + cellWidth / atlasWidth;
+            const float t1 = t0 + cellHeight / atlasHeight;
+            const float x0 = penX - 1.0f, x1 = x0 + cellWidth;
+            const float y0 = top, y1 = top + cellHeight;
+            const float quad[6][4] = {{x0, y0, s0, t0}, {x1, y0, s1, t0}, {x1, y1, s1, t1},
+                                      {x0, y0, s0, t0}, {x1, y1, s1, t1}, {x0, y1, s0, t1}};
+            std::copy(&quad[0][0], &quad[0][0] + 24, vertices + glyphCount * 24);
+            ++glyphCount;
+        }
+        penX += advances[glyph];
+    }
+    if (glyphCount > firstGlyph)
+        lines[lineCount++] = {firstGlyph, glyphCount - firstGlyph};
+}
+
+/**
+ * @brief Uploads the text added since begin() and submits one overlay packet per line.
+ *
+ * The packets carry their line number as sort depth, so they draw in the order the lines
+ * were added. The vertices must stay in place until the queue is flushed, which the frame
+ * arena guarantees.
+ */
+void TextOverlay::submit(RenderQueue &queue)
+{
+    if (glyphCount > 0 && atlas) {
+        vbo.bind();
+        vbo.write(0, vertices, glyphCount * 24 * int(sizeof(float)));
+        vbo.release();
+        for (int i = 0; i < lineCount; ++i) {
+            DrawPacket packet;
+            packet.key = RenderQueue::makeKey(RenderQueue::Overlay, programId, atlasId, vaoId,
+                                              float(i));
+            packet.first = lines[i].firstGlyph * 6;
+            packet.count = lines[i].glyphCount * 6;
+            packet.instanceCount = 1;
+            queue.submit(packet);
+        }
+    }
+    vertices = nullptr;
+    glyphCount = 0;
+    lines = nullptr;
+    lineCount = 0;
+}
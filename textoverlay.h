@@ -0,0 +1,111 @@
+#ifndef TEXTOVERLAY_H
+#define TEXTOVERLAY_H
+
+#include <QFont>
+#include <QOpenGLBuffer>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLTexture>
+#include <QOpenGLVertexArrayObject>
+#include "framearena.h"
+#include "renderqueue.h"
+
+/**
+ * @brief One line of overlay text, formatted into frame arena memory.
+ *
+ * Replaces QString::arg() chains on the render path: numbers are formatted by hand (always
+ * with a '.' decimal point, like QString::arg()) and nothing touches the heap. Text beyond
+ * MaxLength characters is cut off.
+ */
+class OverlayLine
+{
+public:
+    static constexpr int MaxLength = 160;
+
+    /// A number printed with a fixed number of decimals, like QString::arg(value, 0, 'f', decimals).
+    struct Fixed
+    {
+        double value;
+        int decimals;
+    };
+
+    explicit OverlayLine(FrameArena &arena);
+
+    OverlayLine &operator<<(const char *text);
+    OverlayLine &operator<<(qint64 value);
+    OverlayLine &operator<<(int value) { return *this << qint64(value); }
+    OverlayLine &operator<<(Fixed value);
+
+    const char *text() const { return chars; }
+    int size() const { return length; }
+
+private:
+    void append(char c);
+
+    char *chars;
+    int length;
+};
+
+/**
+ * @brief Draws screen-space text from a glyph atlas with one draw call per frame.
+ *
+ * The printable ASCII glyphs of a font are rendered into a texture once (and again only when
+ * the font or the device pixel ratio changes); each frame the text is turned into textured
+ * quads in frame arena memory and submitted to the render queue as one overlay packet per
+ * line, drawn over the scene. Unlike a QPainter on the widget, this neither allocates nor
+ * touches GL state that the queue does not track.
+ */
+class TextOverlay : protected QOpenGLExtraFunctions
+{
+public:
+    static constexpr int MaxGlyphs = 1024; ///< Per frame; further text is dropped.
+    static constexpr int MaxLines = 64;    ///< Per frame; further lines are dropped.
+
+    TextOverlay();
+    ~TextOverlay();
+
+    void initialize(RenderQueue &queue);
+    void destroy();
+    void setFont(const QFont &font, qreal pixelRatio);
+
+    void begin(FrameArena &arena, int width, int height);
+    void addText(float x, float baseline, const OverlayLine &line);
+    void submit(RenderQueue &queue);
+
+private:
+    static constexpr int FirstGlyph = 32;
+    static constexpr int GlyphCount = 96;
+    static constexpr int AtlasColumns = 16;
+
+    struct LineRange
+    {
+        int firstGlyph;
+        int glyphCount;
+    };
+
+    QOpenGLShaderProgram program;
+    QOpenGLBuffer vbo { QOpenGLBuffer::VertexBuffer };
+    QOpenGLVertexArrayObject vao;
+    QOpenGLTexture *atlas;
+    QFont atlasFont;
+    qreal atlasPixelRatio;
+    float cellWidth;  ///< Logical pixels, including one pixel of padding on each side.
+    float cellHeight;
+    float ascent;
+    float advances[GlyphCount];
+    int scaleLocation;
+    int colorLocation;
+    int atlasLocation;
+    RenderQueue *renderQueue; ///< Holds the registrations below.
+    int programId;
+    int vaoId;
+    int atlasId;
+    float *vertices; ///< Frame arena memory, four floats (x, y, s, t) per vertex.
+    int glyphCount;
+    LineRange *lines; ///< Frame arena memory.
+    int lineCount;
+    int viewWidth;
+    int viewHeight;
+};
+
+#endif // TEXTOVERLAY_H
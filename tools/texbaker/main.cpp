@@ -0,0 +1,159 @@
+/**
+ * @file main.cpp
+ * @brief Offline texture baker: converts a PNG strip into a KTX array texture.
+ *
+ * The input holds square tiles stacked vertically (like textures/texture.png, one tile per
+ * animation phase). Each tile becomes one layer of a 2D array texture; the baker flips it
+ * into OpenGL row order, builds the full mip chain with a gamma-aware box filter and
+ * optionally compresses every level to BC1 (S3TC) or ETC2. The application uploads the
+ * result without decoding, see CubeRenderer::loadBakedTexture().
+ *
+ * Usage: texbaker [--format rgba8|bc1|etc2] [--layers N] [--no-mips] input.png output.ktx
+ */
+
+#include "ktxfile.h"
+#include "texturecompressor.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QImage>
+#include <QTextStream>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+float toLinear(int value)
+{
+    return std::pow(value / 255.0f, 2.2f);
+}
+
+int fromLinear(float value)
+{
+    return std::clamp(int(std::lround(std::pow(value, 1.0f / 2.2f) * 255.0f)), 0, 255);
+}
+
+/**
+ * Halves an RGBA8888 image with a 2x2 box filter. Color is averaged in linear space so
+ * distant cubes keep the brightness of the full-size texture; alpha is averaged directly.
+ * Odd sizes repeat the last row or column.
+ */
+QImage downsample(const QImage &image)
+{
+    const int w = std::max(1, image.width() / 2);
+    const int h = std::max(1, image.height() / 2);
+    QImage result(w, h, QImage::Format_RGBA8888);
+    for (int y = 0; y < h; ++y) {
+        const uchar *rows[2] = {image.constScanLine(std::min(2 * y, image.height() - 1)),
+                                image.constScanLine(std::min(2 * y + 1, image.height() - 1))};
+        uchar *out = result.scanLine(y);
+        for (int x = 0; x < w; ++x) {
+            const int columns[2] = {std::min(2 * x, image.width() - 1) * 4,
+                                    std::min(2 * x + 1, image.width() - 1) * 4};
+            for (int c = 0; c < 4; ++c) {
+                float sum = 0.0f;
+                for (const uchar *row : rows)
+                    for (int column : columns)
+                        sum += c < 3 ? toLinear(row[column + c]) : row[column + c];
+                out[x * 4 + c] = uchar(c < 3 ? fromLinear(sum / 4.0f) : std::lround(sum / 4.0f));
+            }
+        }
+    }
+    return result;
+}
+
+QByteArray encode(const QImage &image, quint32 internalFormat)
+{
+    switch (internalFormat) {
+    case KtxFormat::CompressedRgbS3tcDxt1:
+        return TextureCompressor::compressBc1(image);
+    case KtxFormat::CompressedRgb8Etc2:
+        return TextureCompressor::compressEtc2(image);
+    default:
+        return QByteArray(reinterpret_cast<const char *>(image.constBits()), image.width() * image.height() * 4);
+    }
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTextStream err(stderr);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Bakes a PNG texture strip into a mipmapped KTX array texture.");
+    parser.addHelpOption();
+    QCommandLineOption formatOption("format", "Texture format: rgba8, bc1 or etc2.", "format", "rgba8");
+    QCommandLineOption layersOption("layers", "Number of layers stacked vertically (default: height / width).",
+                                    "count");
+    QCommandLineOption noMipsOption("no-mips", "Store the base level only.");
+    parser.addOption(formatOption);
+    parser.addOption(layersOption);
+    parser.addOption(noMipsOption);
+    parser.addPositionalArgument("input", "PNG strip to bake.");
+    parser.addPositionalArgument("output", "KTX file to write.");
+    parser.process(app);
+
+    const QStringList args = parser.positionalArguments();
+    if (args.size() != 2)
+        parser.showHelp(1);
+
+    const QString format = parser.value(formatOption);
+    quint32 internalFormat;
+    if (format == "rgba8")
+        internalFormat = KtxFormat::Rgba8;
+    else if (format == "bc1")
+        internalFormat = KtxFormat::CompressedRgbS3tcDxt1;
+    else if (format == "etc2")
+        internalFormat = KtxFormat::CompressedRgb8Etc2;
+    else {
+        err << "Unknown format " << format << Qt::endl;
+        return 1;
+    }
+
+    const QImage strip = QImage(args.at(0)).convertToFormat(QImage::Format_RGBA8888);
+    if (strip.isNull()) {
+        err << "Cannot load " << args.at(0) << Qt::endl;
+        return 1;
+    }
+    const int layers = parser.isSet(layersOption) ? parser.value(layersOption).toInt()
+                                                  : strip.height() / std::max(1, strip.width());
+    if (layers < 1 || strip.height() % layers != 0) {
+        err << "The image height is not a multiple of " << layers << " layers" << Qt::endl;
+        return 1;
+    }
+    const int width = strip.width();
+    const int height = strip.height() / layers;
+
+    // Row 0 of a KTX image is the bottom row (OpenGL order), hence the flip.
+    QList<QImage> images;
+    for (int layer = 0; layer < layers; ++layer)
+        images.append(strip.copy(0, layer * height, width, height).mirrored());
+
+    QList<QByteArray> levels;
+    for (;;) {
+        QByteArray level;
+        for (const QImage &image : images)
+            level.append(encode(image, internalFormat));
+        levels.append(level);
+        if (parser.isSet(noMipsOption) || (images.first().width() == 1 && images.first().height() == 1))
+            break;
+        for (QImage &image : images)
+            image = downsample(image);
+    }
+
+    QString error;
+    const KtxFormat::Header header = KtxFormat::makeHeader(internalFormat, width, height, layers, levels.size());
+    if (!KtxFile::write(args.at(1), header, levels, &error)) {
+        err << "Cannot write " << args.at(1) << ": " << error << Qt::endl;
+        return 1;
+    }
+
+    qint64 bytes = 0;
+    for (const QByteArray &level : levels)
+        bytes += level.size();
+    QTextStream(stdout) << "Wrote " << args.at(1) << ": " << layers << " layers of " << width << "x" << height
+                        << ", " << levels.size() << " mip levels, " << bytes << " bytes of texture data" << Qt::endl;
+    return 0;
+}
@@ -0,0 +1,19 @@
+QT = core gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = texbaker
+TEMPLATE = app
+
+# Shares the KTX reader/writer with the application.
+INCLUDEPATH += ../..
+
+SOURCES += \
+    ../../ktxfile.cpp \
+    main.cpp \
+    texturecompressor.cpp
+
+HEADERS += \
+    ../../ktxfile.h \
+    texturecompressor.h
@@ -0,0 +1,315 @@
+/**
+ * @file texturecompressor.cpp
+ * @brief BC1 and ETC1/ETC2 block encoders used by the texture baker.
+ *
+ * The encoders favour simplicity over speed: BC1 takes its endpoints from the principal
+ * axis of the block's colors, ETC1 tries both subblock layouts and both base color modes
+ * with every modifier table and keeps the lowest squared error. Baking happens offline on
+ * small textures, so exhaustive search is affordable.
+ */
+
+#include "texturecompressor.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+namespace {
+
+int squaredError(const int *a, const quint8 *b)
+{
+    int error = 0;
+    for (int c = 0; c < 3; ++c) {
+        const int d = a[c] - int(b[c]);
+        error += d * d;
+    }
+    return error;
+}
+
+// --- BC1 ---
+
+quint16 packRgb565(const float *color)
+{
+    const int r = std::clamp(int(std::lround(color[0] * 31.0f / 255.0f)), 0, 31);
+    const int g = std::clamp(int(std::lround(color[1] * 63.0f / 255.0f)), 0, 63);
+    const int b = std::clamp(int(std::lround(color[2] * 31.0f / 255.0f)), 0, 31);
+    return quint16((r << 11) | (g << 5) | b);
+}
+
+void unpackRgb565(quint16 packed, int *color)
+{
+    const int r = (packed >> 11) & 31;
+    const int g = (packed >> 5) & 63;
+    const int b = packed & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+// --- ETC1 ---
+
+// Intensity modifiers (small, large) of the eight ETC1 tables.
+const int kModifierTables[8][2] = {
+    {2, 8}, {5, 17}, {9, 29}, {13, 42}, {18, 60}, {24, 80}, {33, 106}, {47, 183}
+};
+
+struct SubBlockFit
+{
+    int error;
+    int table;
+    int selectors[8]; ///< 0: +small, 1: +large, 2: -small, 3: -large.
+};
+
+/// Pixel numbers (y * 4 + x) of the two subblocks, for flip = 0 (2x4) and flip = 1 (4x2).
+void subBlockPixels(int flip, int subBlock, int *pixels)
+{
+    int n = 0;
+    for (int y = 0; y < 4; ++y) {
+        for (int x = 0; x < 4; ++x) {
+            const int half = flip ? y / 2 : x / 2;
+            if (half == subBlock)
+                pixels[n++] = y * 4 + x;
+        }
+    }
+}
+
+SubBlockFit fitSubBlock(const quint8 *pixels, const int *ids, const int *base)
+{
+    SubBlockFit best;
+    best.error = INT_MAX;
+    for (int table = 0; table < 8; ++table) {
+        SubBlockFit fit;
+        fit.error = 0;
+        fit.table = table;
+        const int modifiers[4] = {kModifierTables[table][0], kModifierTables[table][1],
+                                  -kModifierTables[table][0], -kModifierTables[table][1]};
+        for (int i = 0; i < 8; ++i) {
+            int bestPixelError = INT_MAX;
+            for (int s = 0; s < 4; ++s) {
+                const int color[3] = {std::clamp(base[0] + modifiers[s], 0, 255),
+                                      std::clamp(base[1] + modifiers[s], 0, 255),
+                                      std::clamp(base[2] + modifiers[s], 0, 255)};
+                const int error = squaredError(color, pixels + ids[i] * 4);
+                if (error < bestPixelError) {
+                    bestPixelError = error;
+                    fit.selectors[i] = s;
+                }
+            }
+            fit.error += bestPixelError;
+        }
+        if (fit.error < best.error)
+            best = fit;
+    }
+    return best;
+}
+
+void writeBigEndian(quint32 value, quint8 *out)
+{
+    out[0] = quint8(value >> 24);
+    out[1] = quint8(value >> 16);
+    out[2] = quint8(value >> 8);
+    out[3] = quint8(value);
+}
+
+/// Calls encode for every 4x4 block of image, clamping reads at the edges.
+template<typename Encoder>
+QByteArray compressImage(const QImage &image, Encoder encode)
+{
+    const QImage rgba = image.convertToFormat(QImage::Format_RGBA8888);
+    const int blocksX = (rgba.width() + 3) / 4;
+    const int blocksY = (rgba.height() + 3) / 4;
+    QByteArray out(blocksX * blocksY * 8, Qt::Uninitialized);
+    quint8 *block = reinterpret_cast<quint8 *>(out.data());
+    quint8 pixels[16 * 4];
+    for (int by = 0; by < blocksY; ++by) {
+        for (int bx = 0; bx < blocksX; ++bx) {
+            for (int y = 0; y < 4; ++y) {
+                const uchar *row = rgba.constScanLine(std::min(by * 4 + y, rgba.height() - 1));
+                for (int x = 0; x < 4; ++x) {
+                    const int sx = std::min(bx * 4 + x, rgba.width() - 1);
+                    std::copy(row + sx * 4, row + sx * 4 + 4, pixels + (y * 4 + x) * 4);
+                }
+            }
+            encode(pixels, block);
+            block += 8;
+        }
+    }
+    return out;
+}
+
+} // namespace
+
+/**
+ * @brief Encodes a block as two RGB565 endpoints and 2-bit indices.
+ *
+ * The endpoints are the extremes of the pixels projected on the principal axis of their
+ * colors (found by power iteration on the covariance matrix). color0 > color1 selects the
+ * four-color mode; a uniform block uses index 0 everywhere.
+ */
+void TextureCompressor::encodeBc1Block(const quint8 *pixels, quint8 *block)
+{
+    float mean[3] = {0.0f, 0.0f, 0.0f};
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < 3; ++c)
+            mean[c] += pixels[i * 4 + c] / 16.0f;
+
+    float cov[3][3] = {};
+    for (int i = 0; i < 16; ++i) {
+        const float d[3] = {pixels[i * 4] - mean[0], pixels[i * 4 + 1] - mean[1], pixels[i * 4 + 2] - mean[2]};
+        for (int r = 0; r < 3; ++r)
+            for (int c = 0; c < 3; ++c)
+                cov[r][c] += d[r] * d[c];
+    }
+    float axis[3] = {0.577f, 0.577f, 0.577f};
+    for (int iteration = 0; iteration < 8; ++iteration) {
+        float next[3];
+        for (int r = 0; r < 3; ++r)
+            next[r] = cov[r][0] * axis[0] + cov[r][1] * axis[1] + cov[r][2] * axis[2];
+        const float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+        if (length < 1e-6f)
+            break;
+        for (int c = 0; c < 3; ++c)
+            axis[c] = next[c] / length;
+    }
+
+    float minT = 0.0f, maxT = 0.0f;
+    for (int i = 0; i < 16; ++i) {
+        const float t = (pixels[i * 4] - mean[0]) * axis[0] + (pixels[i * 4 + 1] - mean[1]) * axis[1]
+                + (pixels[i * 4 + 2] - mean[2]) * axis[2];
+        minT = std::min(minT, t);
+        maxT = std::max(maxT, t);
+    }
+    float high[3], low[3];
+    for (int c = 0; c < 3; ++c) {
+        high[c] = std::clamp(mean[c] + axis[c] * maxT, 0.0f, 255.0f);
+        low[c] = std::clamp(mean[c] + axis[c] * minT, 0.0f, 255.0f);
+    }
+    quint16 color0 = packRgb565(high);
+    quint16 color1 = packRgb565(low);
+    if (color0 < color1)
+        std::swap(color0, color1);
+
+    quint32 indices = 0;
+    if (color0 != color1) {
+        int palette[4][3];
+        unpackRgb565(color0, palette[0]);
+        unpackRgb565(color1, palette[1]);
+        for (int c = 0; c < 3; ++c) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        for (int i = 0; i < 16; ++i) {
+            int bestIndex = 0;
+            int bestError = INT_MAX;
+            for (int p = 0; p < 4; ++p) {
+                const int error = squaredError(palette[p], pixels + i * 4);
+                if (error < bestError) {
+                    bestError = error;
+                    bestIndex = p;
+                }
+            }
+            indices |= quint32(bestIndex) << (2 * i);
+        }
+    }
+
+    block[0] = quint8(color0);
+    block[1] = quint8(color0 >> 8);
+    block[2] = quint8(color1);
+    block[3] = quint8(color1 >> 8);
+    block[4] = quint8(indices);
+    block[5] = quint8(indices >> 8);
+    block[6] = quint8(indices >> 16);
+    block[7] = quint8(indices >> 24);
+}
+
+/**
+ * @brief Encodes a block in ETC1 "individual" or "differential" mode.
+ *
+ * Differential mode is only chosen when the second base color is within the 3-bit delta
+ * range, so the block never overflows into the ETC2-only T, H and planar modes and decodes
+ * identically on ETC1 and ETC2 hardware.
+ */
+void TextureCompressor::encodeEtc2Block(const quint8 *pixels, quint8 *block)
+{
+    int bestError = INT_MAX;
+    quint32 bestHigh = 0, bestLow = 0;
+    for (int flip = 0; flip < 2; ++flip) {
+        int ids[2][8];
+        float average[2][3] = {};
+        for (int s = 0; s < 2; ++s) {
+            subBlockPixels(flip, s, ids[s]);
+            for (int i = 0; i < 8; ++i)
+                for (int c = 0; c < 3; ++c)
+                    average[s][c] += pixels[ids[s][i] * 4 + c] / 8.0f;
+        }
+
+        for (int differential = 0; differential < 2; ++differential) {
+            const int levels = differential ? 31 : 15;
+            int quantized[2][3], base[2][3];
+            for (int s = 0; s < 2; ++s) {
+                for (int c = 0; c < 3; ++c) {
+                    const int q = std::clamp(int(std::lround(average[s][c] * levels / 255.0f)), 0, levels);
+                    quantized[s][c] = q;
+                    base[s][c] = differential ? (q << 3) | (q >> 2) : (q << 4) | q;
+                }
+            }
+            int delta[3];
+            bool valid = true;
+            for (int c = 0; c < 3; ++c) {
+                delta[c] = quantized[1][c] - quantized[0][c];
+                valid = valid && (!differential || (delta[c] >= -4 && delta[c] <= 3));
+            }
+            if (!valid)
+                continue;
+
+            const SubBlockFit fits[2] = {fitSubBlock(pixels, ids[0], base[0]),
+                                         fitSubBlock(pixels, ids[1], base[1])};
+            const int error = fits[0].error + fits[1].error;
+            if (error >= bestError)
+                continue;
+            bestError = error;
+
+            quint32 high = 0;
+            for (int c = 0; c < 3; ++c) {
+                const int shift = 24 - c * 8;
+                if (differential)
+                    high |= quint32(quantized[0][c] << 3 | (delta[c] & 7)) << shift;
+                else
+                    high |= quint32(quantized[0][c] << 4 | quantized[1][c]) << shift;
+            }
+            high |= quint32(fits[0].table) << 5 | quint32(fits[1].table) << 2;
+            high |= quint32(differential) << 1 | quint32(flip);
+
+            // Pixel indices are stored column-major: bit x * 4 + y of each half holds pixel (x, y).
+            quint32 low = 0;
+            for (int s = 0; s < 2; ++s) {
+                for (int i = 0; i < 8; ++i) {
+                    const int x = ids[s][i] % 4;
+                    const int y = ids[s][i] / 4;
+                    const int bit = x * 4 + y;
+                    low |= quint32(fits[s].selectors[i] >> 1) << (16 + bit);
+                    low |= quint32(fits[s].selectors[i] & 1) << bit;
+                }
+            }
+            bestHigh = high;
+            bestLow = low;
+        }
+    }
+    writeBigEndian(bestHigh, block);
+    writeBigEndian(bestLow, block + 4);
+}
+
+/**
+ * @brief Compresses an image to BC1 blocks, row by row.
+ */
+QByteArray TextureCompressor::compressBc1(const QImage &image)
+{
+    return compressImage(image, encodeBc1Block);
+}
+
+/**
+ * @brief Compresses an image to ETC2 RGB8 blocks, row by row.
+ */
+QByteArray TextureCompressor::compressEtc2(const QImage &image)
+{
+    return compressImage(image, encodeEtc2Block);
+}
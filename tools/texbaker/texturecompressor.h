@@ -0,0 +1,27 @@
+#ifndef TEXTURECOMPRESSOR_H
+#define TEXTURECOMPRESSOR_H
+
+#include <QByteArray>
+#include <QImage>
+
+/**
+ * @brief Block compressors for the formats the baker can emit.
+ *
+ * Both formats store 4x4 pixel blocks in 8 bytes (4 bits per pixel, an eighth of RGBA8) and
+ * drop alpha. Images whose size is not a multiple of four are padded by repeating the edge
+ * pixels, which the GPU never samples.
+ */
+namespace TextureCompressor {
+
+/// Encodes one block of 16 RGBA8 pixels (row-major) as BC1 (DXT1).
+void encodeBc1Block(const quint8 *pixels, quint8 *block);
+
+/// Encodes one block of 16 RGBA8 pixels (row-major) as ETC1, which every ETC2 decoder accepts.
+void encodeEtc2Block(const quint8 *pixels, quint8 *block);
+
+QByteArray compressBc1(const QImage &image);
+QByteArray compressEtc2(const QImage &image);
+
+} // namespace TextureCompressor
+
+#endif // TEXTURECOMPRESSOR_H
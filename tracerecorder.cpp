@@ -0,0 +1,334 @@
+/**
+ * @file tracerecorder.cpp
+ * @brief Recording and deterministic replay of input, menu actions and timer ticks.
+ *
+ * TraceRecorder appends one fixed-size record per event (mouse press/move, wheel, menu actions,
+ * animation and texture timer ticks, resizes and rendered frames) with a nanosecond timestamp.
+ * TraceReplayer feeds the records back into a CubeWidget whose own timers are disabled, so the
+ * exact same sequence of state changes and frames is reproduced, either at the recorded pace
+ * or as fast as possible. Each recorded frame is re-rendered synchronously (with glFinish),
+ * timed and its heap allocations counted (see AllocStats), which gives comparable frame
+ * statistics across builds for the same workload.
+ */
+
+#include "tracerecorder.h"
+#include "cubewidget.h"
+#include <QTextStream>
+#include <QTimer>
+#include <algorithm>
+#include <cstring>
+
+using namespace TraceFormat;
+
+/**
+ * @brief Constructs an idle recorder.
+ */
+TraceRecorder::TraceRecorder()
+{
+}
+
+/**
+ * @brief Closes the trace if it is still open.
+ */
+TraceRecorder::~TraceRecorder()
+{
+    close();
+}
+
+/**
+ * @brief Creates the trace file and starts the recording clock.
+ * @param path Path of the trace file.
+ * @return true on success; see errorString() otherwise.
+ */
+bool TraceRecorder::open(const QString &path)
+{
+    file.setFileName(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+    const Header header {Magic, Version, sizeof(Record), 0};
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    clock.start();
+    return true;
+}
+
+/**
+ * @brief Flushes and closes the trace file.
+ */
+void TraceRecorder::close()
+{
+    if (file.isOpen())
+        file.close();
+}
+
+/**
+ * @brief Appends an event to the trace.
+ * @param type Event type.
+ * @param args Up to seven event arguments (see TraceFormat::EventType).
+ * @param buttons Mouse buttons held, for mouse events.
+ */
+void TraceRecorder::record(EventType type, std::initializer_list<float> args, quint16 buttons)
+{
+    if (!file.isOpen())
+        return;
+    Record record;
+    std::memset(&record, 0, sizeof(record));
+    record.timestampNs = quint64(clock.nsecsElapsed());
+    record.type = type;
+    record.buttons = buttons;
+    std::copy_n(args.begin(), std::min<size_t>(args.size(), 7), record.args);
+    file.write(reinterpret_cast<const char *>(&record), sizeof(record));
+}
+
+/**
+ * @brief Returns the frame time (in ns) below which the given fraction of frames fall.
+ * @param p Fraction between 0 and 1.
+ */
+qint64 FrameStatistics::percentile(double p) const
+{
+    if (frames.isEmpty())
+        return 0;
+    QList<qint64> sorted;
+    sorted.reserve(frames.size());
+    for (const Frame &frame : frames)
+        sorted.append(frame.ns);
+    std::sort(sorted.begin(), sorted.end());
+    const int index = std::clamp(int(p * (sorted.size() - 1) + 0.5), 0, int(sorted.size()) - 1);
+    return sorted[index];
+}
+
+/**
+ * @brief Returns the number of frames after the first warmupFrames that allocated heap memory.
+ *
+ * The first frames may allocate while caches, GL objects and the frame arena grow to the
+ * workload; after that the render path is expected not to touch the heap.
+ */
+int FrameStatistics::allocatingFrames(int warmupFrames) const
+{
+    int count = 0;
+    for (int i = warmupFrames; i < frames.size(); ++i)
+        if (frames[i].allocations > 0)
+            ++count;
+    return count;
+}
+
+/**
+ * @brief Returns a one-line human-readable summary of the frame times.
+ */
+QString FrameStatistics::summary() const
+{
+    if (frames.isEmpty())
+        return "frames: 0";
+    qint64 total = 0;
+    for (const Frame &frame : frames)
+        total += frame.ns;
+    auto ms = [](qint64 ns) { return QString::number(ns / 1.0e6, 'f', 3); };
+    return QString("frames: %1  mean: %2 ms  p50: %3 ms  p95: %4 ms  p99: %5 ms  max: %6 ms")
+            .arg(frames.size())
+            .arg(ms(total / frames.size()))
+            .arg(ms(percentile(0.50)))
+            .arg(ms(percentile(0.95)))
+            .arg(ms(percentile(0.99)))
+            .arg(ms(percentile(1.0)));
+}
+
+/**
+ * @brief Returns a one-line summary of the heap allocations made while rendering.
+ * @param warmupFrames Number of initial frames not counted as steady state.
+ */
+QString FrameStatistics::allocationSummary(int warmupFrames) const
+{
+    quint64 allocations = 0, bytes = 0;
+    int first = -1;
+    for (int i = 0; i < frames.size(); ++i) {
+        allocations += frames[i].allocations;
+        bytes += frames[i].bytes;
+        if (first < 0 && i >= warmupFrames && frames[i].allocations > 0)
+            first = i;
+    }
+    QString text = QString("heap: %1 allocations, %2 bytes in %3 frames; after %4 warm-up frames: %5 allocating frames")
+            .arg(allocations)
+            .arg(bytes)
+            .arg(frames.size())
+            .arg(warmupFrames)
+            .arg(allocatingFrames(warmupFrames));
+    if (first >= 0)
+        text += QString(" (first: frame %1, %2 allocations)").arg(first).arg(frames[first].allocations);
+    return text;
+}
+
+/**
+ * @brief Writes one line per frame ("frame,ns,allocations,bytes") for comparison between builds.
+ */
+bool FrameStatistics::writeCsv(const QString &path) const
+{
+    QFile out(path);
+    if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+        return false;
+    QTextStream stream(&out);
+    stream << "frame,ns,allocations,bytes\n";
+    for (int i = 0; i < frames.size(); ++i)
+        stream << i << ',' << frames[i].ns << ',' << frames[i].allocations << ',' << frames[i].bytes << '\n';
+    return true;
+}
+
+/**
+ * @brief Constructs a replayer driving the given widget.
+ */
+TraceReplayer::TraceReplayer(CubeWidget *widget, QObject *parent)
+    : QObject(parent),
+      widget(widget),
+      next(0),
+      mode(AsFastAsPossible)
+{
+}
+
+/**
+ * @brief Reads a whole trace file into memory.
+ * @param path Path of the trace file.
+ * @param errorMessage Receives the reason on failure (may be nullptr).
+ * @return true on success; truncated traces are rejected.
+ */
+bool TraceReplayer::load(const QString &path, QString *errorMessage)
+{
+    QFile in(path);
+    if (!in.open(QIODevice::ReadOnly)) {
+        if (errorMessage)
+            *errorMessage = in.errorString();
+        return false;
+    }
+    const QByteArray bytes = in.readAll();
+    Header header;
+    if (bytes.size() < qsizetype(sizeof(header))) {
+        if (errorMessage)
+            *errorMessage = "File is too small to be a trace";
+        return false;
+    }
+    std::memcpy(&header, bytes.constData(), sizeof(header));
+    if (header.magic != Magic || header.version != Version || header.recordSize != sizeof(Record)) {
+        if (errorMessage)
+            *errorMessage = "Not a trace file or unsupported trace version";
+        return false;
+    }
+    const qsizetype payload = bytes.size() - qsizetype(sizeof(header));
+    if (payload % qsizetype(sizeof(Record)) != 0) {
+        // E.g. the recording was killed mid-write; replaying the rest would measure a
+        // different workload than the one recorded.
+        if (errorMessage)
+            *errorMessage = "The trace ends with an incomplete record";
+        return false;
+    }
+    const qsizetype count = payload / qsizetype(sizeof(Record));
+    records.resize(count);
+    std::memcpy(records.data(), bytes.constData() + sizeof(header), count * sizeof(Record));
+    return true;
+}
+
+/**
+ * @brief Starts replaying from the beginning of the trace.
+ * @param replayMode Whether to honour the recorded timestamps or run as fast as possible.
+ *
+ * The widget's timers are switched off so that animation and texture ticks only come from
+ * the trace, and frames are finished before being timed. The widget's window is disabled
+ * meanwhile, so live mouse, keyboard and menu input cannot change the replayed session (it
+ * still repaints). finished() is emitted at the end.
+ */
+void TraceReplayer::start(Mode replayMode)
+{
+    mode = replayMode;
+    next = 0;
+    stats.clear();
+    stats.reserve(int(std::count_if(records.cbegin(), records.cend(),
+                                    [](const Record &r) { return r.type == Frame; })));
+    widget->window()->setEnabled(false);
+    widget->setExternalClock(true);
+    widget->setFinishFrames(true);
+    clock.start();
+    QTimer::singleShot(0, this, &TraceReplayer::step);
+}
+
+/**
+ * @brief Dispatches every record that is due and schedules the next step.
+ */
+void TraceReplayer::step()
+{
+    while (next < records.size()
+           && (mode == AsFastAsPossible || records[next].timestampNs <= quint64(clock.nsecsElapsed())))
+        dispatch(records[next++]);
+
+    if (next >= records.size()) {
+        widget->setFinishFrames(false);
+        widget->setExternalClock(false);
+        widget->window()->setEnabled(true);
+        emit finished();
+        return;
+    }
+    const qint64 waitMs = (qint64(records[next].timestampNs) - clock.nsecsElapsed()) / 1000000;
+    QTimer::singleShot(std::max<qint64>(0, waitMs), Qt::PreciseTimer, this, &TraceReplayer::step);
+}
+
+/**
+ * @brief Applies one recorded event to the widget.
+ */
+void TraceReplayer::dispatch(const Record &record)
+{
+    const float *a = record.args;
+    switch (record.type) {
+    case MousePress:
+        widget->handleMousePress(QPoint(qRound(a[0]), qRound(a[1])));
+        break;
+    case MouseMove:
+        widget->handleMouseMove(QPoint(qRound(a[0]), qRound(a[1])), Qt::MouseButtons::fromInt(record.buttons));
+        break;
+    case Wheel:
+        widget->handleWheel(qRound(a[0]));
+        break;
+    case LineRotation:
+        widget->setCustomRotation(QVector3D(a[0], a[1], a[2]), QVector3D(a[3], a[4], a[5]), a[6]);
+        break;
+    case LineAnimation:
+        widget->setLineAnimation(QVector3D(a[0], a[1], a[2]), QVector3D(a[3], a[4], a[5]), a[6]);
+        break;
+    case ViewPosition:
+        widget->setViewPosition(QVector3D(a[0], a[1], a[2]), QVector3D(a[3], a[4], a[5]));
+        break;
+    case ToggleGloss:
+        widget->toggleGloss();
+        break;
+    case ResetDefault:
+        widget->resetDefault();
+        break;
+    case ToggleAnimation:
+        widget->toggleAnimation();
+        break;
+    case ToggleLights:
+        widget->toggleLights();
+        break;
+    case AnimationTick:
+        widget->onAnimationTimer();
+        break;
+    case TextureTick:
+        widget->updateTexture();
+        break;
+    case Resize: {
+        // Resize the top-level window so that the widget ends up with the recorded size once
+        // the window system applies it, and the widget itself now so the next frame has it.
+        // The paint the resize triggers is skipped by the widget (external clock).
+        const QSize size(qRound(a[0]), qRound(a[1]));
+        QWidget *top = widget->window();
+        top->resize(top->size() + size - widget->size());
+        widget->resize(size);
+        break;
+    }
+    case Frame: {
+        QElapsedTimer frame;
+        frame.start();
+        widget->renderFrame();
+        const qint64 ns = frame.nsecsElapsed();
+        const AllocStats::Counters &heap = widget->frameAllocations();
+        stats.addFrame({ns, heap.allocations, heap.bytes});
+        break;
+    }
+    default:
+        break;
+    }
+}
@@ -0,0 +1,131 @@
+#ifndef TRACERECORDER_H
+#define TRACERECORDER_H
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <QtGlobal>
+#include <initializer_list>
+
+class CubeWidget;
+
+namespace TraceFormat {
+
+constexpr quint32 Magic = 0x43525443; ///< "CTRC" in a little-endian file.
+constexpr quint32 Version = 1;
+
+enum EventType : quint16 {
+    MousePress = 1,      ///< args: x, y
+    MouseMove = 2,       ///< args: x, y
+    Wheel = 3,           ///< args: angle delta (y)
+    LineRotation = 4,    ///< args: b.xyz, d.xyz, angle
+    ViewPosition = 5,    ///< args: eye.xyz, center.xyz
+    ToggleGloss = 6,
+    ResetDefault = 7,
+    ToggleAnimation = 8,
+    ToggleLights = 9,
+    AnimationTick = 10,
+    TextureTick = 11,
+    Resize = 12,         ///< args: width, height
+    Frame = 13,          ///< A frame was rendered at this point of the event stream.
+    LineAnimation = 14   ///< args: b.xyz, d.xyz, degrees per tick
+};
+
+struct Header
+{
+    quint32 magic;
+    quint32 version;
+    quint32 recordSize;
+    quint32 reserved;
+};
+
+struct Record
+{
+    quint64 timestampNs; ///< Time since the start of the recording.
+    quint16 type;        ///< EventType.
+    quint16 buttons;     ///< Qt::MouseButtons for mouse events.
+    float args[7];
+};
+
+static_assert(sizeof(Header) == 16, "unexpected trace header size");
+static_assert(sizeof(Record) == 40, "unexpected trace record size");
+
+} // namespace TraceFormat
+
+class TraceRecorder
+{
+public:
+    TraceRecorder();
+    ~TraceRecorder();
+
+    bool open(const QString &path);
+    void close();
+    bool isRecording() const { return file.isOpen(); }
+    QString errorString() const { return file.errorString(); }
+
+    void record(TraceFormat::EventType type, std::initializer_list<float> args = {}, quint16 buttons = 0);
+
+private:
+    QFile file;
+    QElapsedTimer clock;
+};
+
+/**
+ * @brief Per-frame timings and heap allocations collected while replaying a trace.
+ */
+class FrameStatistics
+{
+public:
+    struct Frame
+    {
+        qint64 ns;
+        quint64 allocations; ///< Heap allocations made while rendering the frame.
+        quint64 bytes;
+    };
+
+    void clear() { frames.clear(); }
+    void reserve(int count) { frames.reserve(count); }
+    void addFrame(const Frame &frame) { frames.append(frame); }
+    int frameCount() const { return frames.size(); }
+    qint64 percentile(double p) const;
+    int allocatingFrames(int warmupFrames) const;
+    QString summary() const;
+    QString allocationSummary(int warmupFrames) const;
+    bool writeCsv(const QString &path) const;
+
+private:
+    QList<Frame> frames;
+};
+
+class TraceReplayer : public QObject
+{
+    Q_OBJECT
+public:
+    enum Mode { RealTime, AsFastAsPossible };
+
+    explicit TraceReplayer(CubeWidget *widget, QObject *parent = nullptr);
+
+    bool load(const QString &path, QString *errorMessage = nullptr);
+    void start(Mode mode);
+    const FrameStatistics &statistics() const { return stats; }
+
+signals:
+    void finished();
+
+private slots:
+    void step();
+
+private:
+    void dispatch(const TraceFormat::Record &record);
+
+    CubeWidget *widget;
+    QList<TraceFormat::Record> records;
+    int next;
+    Mode mode;
+    QElapsedTimer clock;
+    FrameStatistics stats;
+};
+
+#endif // TRACERECORDER_H